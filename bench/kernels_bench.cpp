@@ -0,0 +1,75 @@
+// Benchmark of the line kernels against the separate passes they replace:
+// min, max and the first NaN of windows of 1e5, 1e6 and 1e7 samples.
+// Built with -DTIMESCAN_BENCH=ON; run without arguments.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <vector>
+#include <chrono>
+#include <blitz/array.h>
+
+#include "kernels.h"
+
+
+// the three blitz reductions the signal buffers used to make
+static LineStats separatePasses(const double * data, long size) {
+  const blitz::Array<double,1> line(const_cast<double*>(data), blitz::shape(size),
+                                    blitz::neverDeleteData);
+  LineStats st;
+  st.firstNaN = blitz::first(blitz_isnan(line));
+  if ( st.firstNaN < 0 )
+    st.firstNaN = -1;
+  st.min = blitz::min(line);
+  st.max = blitz::max(line);
+  return st;
+}
+
+
+// best of the repetitions, in ms
+template <class Kernel>
+static double timeIt(Kernel kernel, const std::vector<double> & data, int reps,
+                     LineStats & result) {
+  double best = INFINITY;
+  for (int rep = 0 ; rep < reps ; rep++) {
+    const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    result = kernel(data.data(), (long) data.size());
+    const std::chrono::duration<double, std::milli> took =
+        std::chrono::steady_clock::now() - start;
+    if ( took.count() < best )
+      best = took.count();
+  }
+  return best;
+}
+
+
+int main() {
+
+  printf("Kernels: %s\n", lineKernelsIsa());
+  printf("%10s %12s %12s %8s\n", "points", "fused (ms)", "passes (ms)", "speedup");
+
+  const long sizes[] = {100000, 1000000, 10000000};
+  for (int sz = 0 ; sz < 3 ; sz++) {
+
+    // a filled window: noise with the unfilled tail at NaN
+    std::vector<double> data(sizes[sz]);
+    srand(1);
+    for (size_t i = 0 ; i < data.size() ; i++)
+      data[i] = i < data.size() * 9 / 10  ?  (double) rand() / RAND_MAX  :  NAN ;
+
+    const int reps = sizes[sz] >= 10000000  ?  10  :  100;
+    LineStats fused, passes;
+    const double tFused = timeIt(lineStats, data, reps, fused);
+    const double tPasses = timeIt(separatePasses, data, reps, passes);
+    if ( fused.min != passes.min || fused.max != passes.max ||
+         fused.firstNaN != passes.firstNaN ) {
+      fprintf(stderr, "Mismatch at %ld points.\n", sizes[sz]);
+      return 1;
+    }
+    printf("%10ld %12.3f %12.3f %8.2f\n", sizes[sz], tFused, tPasses, tPasses / tFused);
+
+  }
+
+  return 0;
+
+}
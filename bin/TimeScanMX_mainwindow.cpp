@@ -12,10 +12,34 @@ struct clargs {
   double interval;
   double period;
   bool cont;
+  bool snapshot;
+  bool aggregate;
+  bool aggregateColumns;
+  std::string storage;
+  double memoryBudget;
+  bool indexAxis;
+  std::string publish;
+  std::string sharedMemory;
+  std::string triggerMode;
+  std::string triggerCondition;
+  double triggerLevel;
+  int triggerPre;
+  int triggerPost;
+  std::string spectrumSignal;
+  std::string spectrumWindow;
+  int spectrumAverages;
+  bool correlation;
+  std::string lagSignals;
+  double renderInterval;
+  std::string renderFormat;
+  double connectTimeout;
+  bool onChange;
   std::string saveDir;
   std::string saveName;
   bool autoName;
   std::vector<std::string> detectors;
+  std::string every;
+  std::string deadband;
   double min;
   bool autoMin;
   double max;
@@ -24,6 +48,7 @@ struct clargs {
   bool norma;
   bool grid;
   bool collapseControl;
+  bool perfToFile;
   bool doNotUpdateConfiguration;
 
   poptmx::OptionTable table;
@@ -37,6 +62,28 @@ clargs::clargs(int argc, char *argv[]) :
   interval(0.1),
   period(1.0),
   cont(false),
+  snapshot(false),
+  aggregate(false),
+  aggregateColumns(false),
+  storage("auto"),
+  memoryBudget(1024),
+  indexAxis(false),
+  publish(),
+  sharedMemory(),
+  triggerMode("off"),
+  triggerCondition(),
+  triggerLevel(0),
+  triggerPre(10),
+  triggerPost(10),
+  spectrumSignal(),
+  spectrumWindow("hann"),
+  spectrumAverages(1),
+  correlation(false),
+  lagSignals(),
+  renderInterval(0),
+  renderFormat("png"),
+  connectTimeout(5),
+  onChange(false),
   saveDir(),
   saveName(),
   autoName(false),
@@ -48,6 +95,7 @@ clargs::clargs(int argc, char *argv[]) :
   norma(false),
   grid(false),
   collapseControl(false),
+  perfToFile(false),
   doNotUpdateConfiguration(false),
   table("Program to graphically represent time changes of an EPICS PV.")
 {
@@ -68,6 +116,86 @@ clargs::clargs(int argc, char *argv[]) :
       .add(poptmx::OPTION,   &cont, 'c', "continue",
            "Continuous monitoring.",
            "Tells the monitoring to keep going after the one period has expired.")
+      .add(poptmx::OPTION,   &snapshot, 'G', "snapshot",
+           "Grouped read of all PVs.",
+           "Reads all PVs with one grouped get per point so that every row is a coherent snapshot.")
+      .add(poptmx::OPTION,   &aggregate, 'a', "aggregate",
+           "Aggregate updates within the interval.",
+           "Records the mean of all PV updates received within the interval"
+           " and shows their min/max envelope on the graph.")
+      .add(poptmx::OPTION,   &aggregateColumns, 0, "aggrcolumns",
+           "Record statistics of the aggregated updates.",
+           "Adds min, max, std and count columns for every signal to the data file."
+           " Has effect only together with the --aggregate option.")
+      .add(poptmx::OPTION,   &storage, 0, "storage",
+           "Precision of the stored samples.",
+           "One of auto, float64, float32, int32 or int16. With \"auto\" the most"
+           " precise one fitting into the memory budget is used.")
+      .add(poptmx::OPTION,   &memoryBudget, 0, "budget",
+           "Memory budget (MB).", "Memory available for the sample buffers with the auto storage.")
+      .add(poptmx::OPTION,   &indexAxis, 0, "indexaxis",
+           "Place the samples one interval apart.",
+           "Does not store the time of every sample: the time axis assumes that"
+           " all points were taken exactly one interval apart.")
+      .add(poptmx::OPTION,   &publish, 0, "publish",
+           "Stream the rows to subscribers.",
+           "TCP port (\"5064\" or \"host:5064\") or local socket name the acquired"
+           " rows are published on.")
+      .add(poptmx::OPTION,   &sharedMemory, 0, "shm",
+           "Mirror the window in shared memory.",
+           "Name of the POSIX shared-memory segment which holds the times and values"
+           " of the window for local readers. See shmring.h for the layout.")
+      .add(poptmx::OPTION,   &triggerMode, 0, "trigger",
+           "Record only the rows around the events.",
+           "One of off, above, below, rising, falling or nonzero: the value of the"
+           " trigger condition above or below the level, crossing it upwards or"
+           " downwards, or turning non-zero.")
+      .add(poptmx::OPTION,   &triggerCondition, 0, "condition",
+           "Trigger condition.", "Signal or expression of the signals tested by the trigger.")
+      .add(poptmx::OPTION,   &triggerLevel, 0, "level",
+           "Trigger level.", "")
+      .add(poptmx::OPTION,   &triggerPre, 0, "pre",
+           "Samples recorded before every event.", "")
+      .add(poptmx::OPTION,   &triggerPost, 0, "post",
+           "Samples recorded after every event.", "")
+      .add(poptmx::OPTION,   &spectrumSignal, 0, "spectrum",
+           "Show the spectrum of a signal.",
+           "Signal whose power spectral density over the window is shown in its own plot.")
+      .add(poptmx::OPTION,   &spectrumWindow, 0, "window",
+           "Window function of the spectrum.",
+           "One of rectangular, hann, hamming or blackman.")
+      .add(poptmx::OPTION,   &spectrumAverages, 0, "averages",
+           "Spectra averaged.",
+           "Number of half-overlapping segments of the window whose spectra are averaged.")
+      .add(poptmx::OPTION,   &correlation, 0, "correlation",
+           "Show the correlation matrix.",
+           "Pearson correlation of every pair of signals over the window.")
+      .add(poptmx::OPTION,   &lagSignals, 0, "lag",
+           "Show the lag scan of two signals.",
+           "Two signals, separated by a comma, whose cross-correlation is shown against the lag.")
+      .add(poptmx::OPTION,   &renderInterval, 0, "render",
+           "Interval between the plot snapshots (sec).",
+           "Renders the plots shown into the directory of the data file periodically"
+           " while the scan goes on, and once more when it stops. 0 for none.")
+      .add(poptmx::OPTION,   &renderFormat, 0, "format",
+           "Format of the plot snapshots.", "One of png, svg or pdf.")
+      .add(poptmx::OPTION,   &connectTimeout, 0, "timeout",
+           "Connection timeout (sec).",
+           "Start waits until all PVs are connected, at most this long. 0 to start at once.")
+      .add(poptmx::OPTION,   &every, 0, "every",
+           "Sample some signals every few intervals.",
+           "List of \"signal=n\" separated by ';': the signal is sampled on every n-th"
+           " interval only and its column left empty in between.")
+      .add(poptmx::OPTION,   &onChange, 0, "onchange",
+           "Record the signals only when they change.",
+           "Values within the deadband of their signal are written as \"=\" and rows"
+           " where nothing changed are left out. Off by default: plain readers of the"
+           " data file expect numbers in every column.")
+      .add(poptmx::OPTION,   &deadband, 0, "deadband",
+           "Deadbands of the signals, with --onchange.",
+           "List of \"signal=band\" separated by ';': the band is \"0\" for any change,"
+           " \"x\" for changes by more than x or \"x%\" for changes by more than x%"
+           " of the value recorded last.")
       .add(poptmx::OPTION, &saveDir,'d', "dir",
            "Directory where the data file is stored.", "")
       .add(poptmx::OPTION,   &saveName, 'f', "file",
@@ -92,6 +220,9 @@ clargs::clargs(int argc, char *argv[]) :
            "Hide the control panel.",
            "Hide (\"collapse\" in terms of Qt's splitter') the control pannel"
            " leaving only the graph and table pannels visible.")
+      .add(poptmx::OPTION,   &perfToFile, 0, "perf",
+           "Record performance statistics.",
+           "Appends timing of the acquisition phases to the end of the data file.")
       .add(poptmx::OPTION,   &doNotUpdateConfiguration, 'S', "nostore",
            "Do not store configuration.","")
       .add_standard_options();
@@ -136,6 +267,23 @@ MainWindow::MainWindow(int argc, char *argv[], QWidget *parent) :
       chart->setPeriod(args.period);
     if ( args.table.count(&args.cont) )
       chart->setContinious(args.cont);
+    chart->setSnapshotRead(args.snapshot);
+    chart->setAggregated(args.aggregate);
+    chart->setAggregateRecorded(args.aggregateColumns);
+    chart->setStorage(QString::fromStdString(args.storage));
+    chart->setMemoryBudget(args.memoryBudget);
+    chart->setRealTime( ! args.indexAxis );
+    chart->setPublishAddress(QString::fromStdString(args.publish));
+    chart->setSharedMemory(QString::fromStdString(args.sharedMemory));
+    chart->setTriggerLevel(args.triggerLevel);
+    chart->setTriggerPre(args.triggerPre);
+    chart->setTriggerPost(args.triggerPost);
+    chart->setSpectrumWindow(QString::fromStdString(args.spectrumWindow));
+    chart->setSpectrumAverages(args.spectrumAverages);
+    chart->setRenderInterval(args.renderInterval);
+    chart->setRenderFormat(QString::fromStdString(args.renderFormat));
+    chart->setConnectTimeout(args.connectTimeout);
+    chart->setOnChangeRecorded(args.onChange);
 
     if ( args.table.count(&args.saveDir) )
       chart->setSaveDir( QString::fromStdString(args.saveDir) );
@@ -145,6 +293,22 @@ MainWindow::MainWindow(int argc, char *argv[], QWidget *parent) :
 
     for (unsigned int i = 0; i < args.detectors.size(); ++i)
       chart->addSignal(QString::fromStdString(args.detectors[i]));
+    foreach (QString item, QString::fromStdString(args.every).split(';', QString::SkipEmptyParts)) {
+      // names of the derived signals start with '='
+      const int eq = item.lastIndexOf('=');
+      if ( eq > 0 )
+        chart->setSignalEvery(item.left(eq).trimmed(), item.mid(eq+1).toInt());
+    }
+    foreach (QString item, QString::fromStdString(args.deadband).split(';', QString::SkipEmptyParts)) {
+      const int eq = item.lastIndexOf('=');
+      if ( eq > 0 )
+        chart->setSignalDeadband(item.left(eq).trimmed(), item.mid(eq+1).trimmed());
+    }
+    chart->setTriggerMode(QString::fromStdString(args.triggerMode));
+    chart->setTriggerCondition(QString::fromStdString(args.triggerCondition));
+    chart->setSpectrumSignal(QString::fromStdString(args.spectrumSignal));
+    chart->setCorrelationShown(args.correlation);
+    chart->setLagSignals(QString::fromStdString(args.lagSignals));
 
     if (args.table.count(&args.min))
       chart->setMin(args.min);
@@ -157,6 +321,7 @@ MainWindow::MainWindow(int argc, char *argv[], QWidget *parent) :
     chart->setNormalized(args.norma);
     chart->setGridVisible(args.grid);
     chart->setControlCollapsed(args.collapseControl);
+    chart->setPerformanceRecorded(args.perfToFile);
 
   } else {
 
@@ -166,6 +331,40 @@ MainWindow::MainWindow(int argc, char *argv[], QWidget *parent) :
       chart->setPeriod(localSettings.value("period").toDouble());
     if ( localSettings.contains("continue") )
       chart->setContinious(localSettings.value("continue").toBool());
+    if ( localSettings.contains("snapshot") )
+      chart->setSnapshotRead(localSettings.value("snapshot").toBool());
+    if ( localSettings.contains("aggregate") )
+      chart->setAggregated(localSettings.value("aggregate").toBool());
+    if ( localSettings.contains("aggregateColumns") )
+      chart->setAggregateRecorded(localSettings.value("aggregateColumns").toBool());
+    if ( localSettings.contains("storage") )
+      chart->setStorage(localSettings.value("storage").toString());
+    if ( localSettings.contains("memoryBudget") )
+      chart->setMemoryBudget(localSettings.value("memoryBudget").toDouble());
+    if ( localSettings.contains("realTime") )
+      chart->setRealTime(localSettings.value("realTime").toBool());
+    if ( localSettings.contains("publish") )
+      chart->setPublishAddress(localSettings.value("publish").toString());
+    if ( localSettings.contains("sharedMemory") )
+      chart->setSharedMemory(localSettings.value("sharedMemory").toString());
+    if ( localSettings.contains("triggerLevel") )
+      chart->setTriggerLevel(localSettings.value("triggerLevel").toDouble());
+    if ( localSettings.contains("triggerPre") )
+      chart->setTriggerPre(localSettings.value("triggerPre").toInt());
+    if ( localSettings.contains("triggerPost") )
+      chart->setTriggerPost(localSettings.value("triggerPost").toInt());
+    if ( localSettings.contains("spectrumWindow") )
+      chart->setSpectrumWindow(localSettings.value("spectrumWindow").toString());
+    if ( localSettings.contains("spectrumAverages") )
+      chart->setSpectrumAverages(localSettings.value("spectrumAverages").toInt());
+    if ( localSettings.contains("renderInterval") )
+      chart->setRenderInterval(localSettings.value("renderInterval").toDouble());
+    if ( localSettings.contains("renderFormat") )
+      chart->setRenderFormat(localSettings.value("renderFormat").toString());
+    if ( localSettings.contains("connectTimeout") )
+      chart->setConnectTimeout(localSettings.value("connectTimeout").toDouble());
+    if ( localSettings.contains("onChange") )
+      chart->setOnChangeRecorded(localSettings.value("onChange").toBool());
 
     if ( localSettings.contains("saveDir") )
       chart->setSaveDir(localSettings.value("saveDir").toString());
@@ -178,8 +377,24 @@ MainWindow::MainWindow(int argc, char *argv[], QWidget *parent) :
     for (int i = 0; i < size; ++i) {
       localSettings.setArrayIndex(i);
       chart->addSignal(localSettings.value("detector").toString());
+      if ( localSettings.contains("every") )
+        chart->setSignalEvery(localSettings.value("detector").toString(),
+                              localSettings.value("every").toInt());
+      if ( localSettings.contains("deadband") )
+        chart->setSignalDeadband(localSettings.value("detector").toString(),
+                                 localSettings.value("deadband").toString());
     }
     localSettings.endArray();
+    if ( localSettings.contains("triggerMode") )
+      chart->setTriggerMode(localSettings.value("triggerMode").toString());
+    if ( localSettings.contains("triggerCondition") )
+      chart->setTriggerCondition(localSettings.value("triggerCondition").toString());
+    if ( localSettings.contains("spectrumSignal") )
+      chart->setSpectrumSignal(localSettings.value("spectrumSignal").toString());
+    if ( localSettings.contains("correlation") )
+      chart->setCorrelationShown(localSettings.value("correlation").toBool());
+    if ( localSettings.contains("lagSignals") )
+      chart->setLagSignals(localSettings.value("lagSignals").toString());
 
 
     if ( localSettings.contains("min") )
@@ -197,14 +412,17 @@ MainWindow::MainWindow(int argc, char *argv[], QWidget *parent) :
       chart->setNormalized(localSettings.value("norma").toBool() );
     if ( localSettings.contains("grid") )
       chart->setGridVisible( localSettings.value("grid").toBool() );
+    if ( localSettings.contains("perf") )
+      chart->setPerformanceRecorded( localSettings.value("perf").toBool() );
 
   }
 
   if ( ! args.doNotUpdateConfiguration )
     connect(chart, SIGNAL(configurationChanged()), SLOT(updateConfiguration()));
 
+  // start() waits for the PVs to connect
   if (args.start)
-    QTimer::singleShot(500, chart, SLOT(start()));
+    chart->start();
 
 
 }
@@ -222,6 +440,28 @@ void MainWindow::updateConfiguration() {
   localSettings.setValue("interval", chart->interval());
   localSettings.setValue("period", chart->period());
   localSettings.setValue("continue", chart->isContinious());
+  localSettings.setValue("snapshot", chart->isSnapshotRead());
+  localSettings.setValue("aggregate", chart->isAggregated());
+  localSettings.setValue("aggregateColumns", chart->isAggregateRecorded());
+  localSettings.setValue("storage", chart->storage());
+  localSettings.setValue("memoryBudget", chart->memoryBudget());
+  localSettings.setValue("realTime", chart->isRealTime());
+  localSettings.setValue("publish", chart->publishAddress());
+  localSettings.setValue("sharedMemory", chart->sharedMemory());
+  localSettings.setValue("triggerMode", chart->triggerMode());
+  localSettings.setValue("triggerCondition", chart->triggerCondition());
+  localSettings.setValue("triggerLevel", chart->triggerLevel());
+  localSettings.setValue("triggerPre", chart->triggerPre());
+  localSettings.setValue("triggerPost", chart->triggerPost());
+  localSettings.setValue("spectrumSignal", chart->spectrumSignal());
+  localSettings.setValue("spectrumWindow", chart->spectrumWindow());
+  localSettings.setValue("spectrumAverages", chart->spectrumAverages());
+  localSettings.setValue("correlation", chart->isCorrelationShown());
+  localSettings.setValue("lagSignals", chart->lagSignals());
+  localSettings.setValue("renderInterval", chart->renderInterval());
+  localSettings.setValue("renderFormat", chart->renderFormat());
+  localSettings.setValue("connectTimeout", chart->connectTimeout());
+  localSettings.setValue("onChange", chart->isOnChangeRecorded());
   localSettings.setValue("saveDir", chart->saveDir());
   localSettings.setValue("saveName", chart->saveName());
   localSettings.setValue("autoName", chart->isAutoName());
@@ -231,6 +471,8 @@ void MainWindow::updateConfiguration() {
   for (int i = 0; i < detectors.size(); ++i) {
     localSettings.setArrayIndex(i);
     localSettings.setValue("detector", detectors[i]);
+    localSettings.setValue("every", chart->signalEvery(detectors[i]));
+    localSettings.setValue("deadband", chart->signalDeadband(detectors[i]));
   }
   localSettings.endArray();
 
@@ -241,6 +483,7 @@ void MainWindow::updateConfiguration() {
   localSettings.setValue("log", chart->isLogarithmic());
   localSettings.setValue("norma", chart->isNormalized());
   localSettings.setValue("grid", chart->isGridVisible());
+  localSettings.setValue("perf", chart->isPerformanceRecorded());
 
 }
 
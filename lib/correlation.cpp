@@ -0,0 +1,167 @@
+#include <math.h>
+
+#include "correlation.h"
+
+
+Correlation::Correlation(int signalsCount) {
+  reset(signalsCount);
+}
+
+
+void Correlation::reset(int signalsCount) {
+  count = signalsCount;
+  anchors.fill(0.0, count);
+  anchored.fill(false, count);
+  Sums zero = {0, 0.0, 0.0, 0.0, 0.0, 0.0};
+  pairs.fill(zero, count * (count - 1) / 2);
+}
+
+
+void Correlation::add(const double * row) {
+  for (int sig = 0 ; sig < count ; sig++)
+    if ( ! anchored[sig] && ! isnan(row[sig]) ) {
+      anchors[sig] = row[sig];
+      anchored[sig] = true;
+    }
+  update(row, 1.0);
+}
+
+
+void Correlation::remove(const double * row) {
+  update(row, -1.0);
+}
+
+
+void Correlation::update(const double * row, double sign) {
+  Sums * sums = pairs.data();
+  for (int first = 0 ; first < count ; first++) {
+    if ( isnan(row[first]) || ! anchored[first] ) {
+      sums += count - first - 1;
+      continue;
+    }
+    const double dx = row[first] - anchors[first];
+    for (int second = first + 1 ; second < count ; second++, sums++) {
+      if ( isnan(row[second]) || ! anchored[second] )
+        continue;
+      if ( sign < 0.0 && ! sums->n ) // was not added: nothing to remove
+        continue;
+      const double dy = row[second] - anchors[second];
+      sums->n += sign > 0.0  ?  1  :  -1 ;
+      sums->sx += sign * dx;
+      sums->sy += sign * dy;
+      sums->sxx += sign * dx * dx;
+      sums->syy += sign * dy * dy;
+      sums->sxy += sign * dx * dy;
+    }
+  }
+}
+
+
+double Correlation::r(int first, int second) const {
+  if ( first == second )
+    return 1.0;
+  if ( first > second )
+    qSwap(first, second);
+  if ( first < 0 || second >= count )
+    return NAN;
+  const Sums & sums = pairs[pair(first, second)];
+  if ( sums.n < 2 )
+    return NAN;
+  const double varx = sums.n * sums.sxx - sums.sx * sums.sx;
+  const double vary = sums.n * sums.syy - sums.sy * sums.sy;
+  if ( varx <= 0.0 || vary <= 0.0 )
+    return NAN;
+  return qBound(-1.0, ( sums.n * sums.sxy - sums.sx * sums.sy ) / sqrt(varx * vary), 1.0);
+}
+
+
+
+
+LagScan::LagScan(QObject * parent) :
+  QThread(parent),
+  rate(0.0),
+  _bestLag(NAN),
+  _bestCoefficient(NAN)
+{}
+
+
+LagScan::~LagScan() {
+  wait();
+}
+
+
+bool LagScan::scan(const QVector<double> & _first, const QVector<double> & _second, double _rate) {
+  if ( isRunning() )
+    return false;
+  first = _first;
+  second = _second;
+  rate = _rate;
+  start(QThread::LowPriority);
+  return true;
+}
+
+
+// Deviations from the mean, NaNs counting as the mean; returns the sum of
+// their squares.
+static double deviations(const QVector<double> & values, int size, QVector<Complex> & out) {
+  double mean = 0.0;
+  int valid = 0;
+  for (int idx = 0 ; idx < size ; idx++)
+    if ( ! isnan(values[idx]) ) {
+      mean += values[idx];
+      valid++;
+    }
+  if (valid)
+    mean /= valid;
+  double squares = 0.0;
+  for (int idx = 0 ; idx < size ; idx++) {
+    const double dev = isnan(values[idx])  ?  0.0  :  values[idx] - mean ;
+    out[idx] = dev;
+    squares += dev * dev;
+  }
+  for (int idx = size ; idx < out.size() ; idx++)
+    out[idx] = 0.0;
+  return squares;
+}
+
+
+void LagScan::run() {
+
+  _lags.clear();
+  _coefficients.clear();
+  _bestLag = NAN;
+  _bestCoefficient = NAN;
+  const int size = qMin(first.size(), second.size());
+  if ( size < 4 || ! ( rate > 0.0 ) )
+    return;
+
+  // padded to twice the length so that the circular correlation does not
+  // wrap around: c[k] = sum x[n] y[n+k] is at k for k >= 0, at nfft+k else
+  const int nfft = FFT::size(2 * size);
+  fft.resize(nfft);
+  bufFirst.resize(nfft);
+  bufSecond.resize(nfft);
+  const double norm = sqrt( deviations(first, size, bufFirst) *
+                            deviations(second, size, bufSecond) );
+  if ( norm == 0.0 )
+    return;
+  fft.forward(bufFirst.data());
+  fft.forward(bufSecond.data());
+  for (int idx = 0 ; idx < nfft ; idx++)
+    bufSecond[idx] *= std::conj(bufFirst[idx]);
+  fft.inverse(bufSecond.data());
+
+  const int maxLag = size / 2;
+  _lags.resize(2 * maxLag + 1);
+  _coefficients.resize(2 * maxLag + 1);
+  for (int lag = -maxLag ; lag <= maxLag ; lag++) {
+    const double coef = bufSecond[ lag >= 0  ?  lag  :  nfft + lag ].real() / norm;
+    _lags[lag + maxLag] = lag / rate;
+    _coefficients[lag + maxLag] = coef;
+    if ( isnan(_bestCoefficient) || fabs(coef) > fabs(_bestCoefficient) ) {
+      _bestCoefficient = coef;
+      _bestLag = lag / rate;
+    }
+  }
+
+}
@@ -0,0 +1,90 @@
+#ifndef CORRELATION_H
+#define CORRELATION_H
+
+#include <QThread>
+#include <QVector>
+
+#include "fft.h"
+
+
+// Pearson correlation of every pair of signals over a sliding window, kept
+// up to date as rows enter (add) and leave (remove) it: O(signals^2) per
+// row instead of rescanning the window. Every pair keeps its own count and
+// co-moment sums over the rows where both values are valid, so a NaN in
+// one signal does not hide the others. As in WindowStats the sums are taken
+// relative to the first valid value of every signal and should be rebuilt
+// (reset() and add()) from time to time.
+class Correlation {
+
+public:
+
+  Correlation(int signalsCount=0);
+
+  void reset(int signalsCount);
+  inline int size() const {return count;}
+  void add(const double * row);    // one value per signal
+  void remove(const double * row);
+  double r(int first, int second) const; // NaN if undefined
+
+private:
+
+  struct Sums {
+    long n;
+    double sx, sy, sxx, syy, sxy;
+  };
+
+  int count;
+  QVector<double> anchors;
+  QVector<bool> anchored;
+  QVector<Sums> pairs; // first < second, row by row of the upper triangle
+  inline int pair(int first, int second) const {
+    return first * count - first * (first + 1) / 2 + second - first - 1;
+  }
+  void update(const double * row, double sign);
+
+};
+
+
+
+// Normalized cross-correlation of two equally long series for the lags up
+// to half their length, computed by FFT on its own thread. A positive lag
+// means that the second series follows the first one.
+class LagScan : public QThread {
+  Q_OBJECT;
+
+public:
+
+  LagScan(QObject * parent=0);
+  ~LagScan();
+
+  // false if a scan is still running; series are oldest first, rate in
+  // samples per second
+  bool scan(const QVector<double> & first, const QVector<double> & second, double rate);
+
+  // valid once finished() is emitted and until the next scan()
+  inline const QVector<double> & lags() const {return _lags;} // seconds
+  inline const QVector<double> & coefficients() const {return _coefficients;}
+  inline double bestLag() const {return _bestLag;} // of the largest |coefficient|
+  inline double bestCoefficient() const {return _bestCoefficient;}
+
+protected:
+
+  virtual void run();
+
+private:
+
+  QVector<double> first;
+  QVector<double> second;
+  double rate;
+  FFT fft;
+  QVector<Complex> bufFirst;
+  QVector<Complex> bufSecond;
+  QVector<double> _lags;
+  QVector<double> _coefficients;
+  double _bestLag;
+  double _bestCoefficient;
+
+};
+
+
+#endif // CORRELATION_H
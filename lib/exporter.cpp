@@ -0,0 +1,482 @@
+#include <QFile>
+#include <QFileInfo>
+#include <QDateTime>
+#include <QtEndian>
+#include <QRegExp>
+#include <QSet>
+#include <stdio.h>
+#include <limits>
+
+#include "exporter.h"
+
+
+static const qint64 chunkRows = 4096;        // rows formatted between progress checks
+static const qint64 chunkElements = 1 << 16; // binary elements written at once
+static const int textFlush = 1 << 20;        // bytes buffered before a text write
+
+#if Q_BYTE_ORDER == Q_LITTLE_ENDIAN
+static const char * const npyFloat = "<f8";
+static const char * const npyInt = "<i8";
+#else
+static const char * const npyFloat = ">f8";
+static const char * const npyInt = ">i8";
+#endif
+
+
+
+// .npy v1.0 preamble: magic, version, header length and the header dict
+// padded with spaces so that the data starts 64-byte aligned.
+static QByteArray npyHeader(const char * descr, const QString & shape, bool fortran) {
+  QByteArray dict = QString("{'descr': '%1', 'fortran_order': %2, 'shape': %3, }")
+      .arg(descr).arg(fortran ? "True" : "False").arg(shape).toLatin1();
+  const int preamble = 10;
+  const int pad = ( 64 - (preamble + dict.size() + 1) % 64 ) % 64;
+  dict.append(QByteArray(pad, ' '));
+  dict.append('\n');
+  QByteArray out("\x93NUMPY\x01\x00", 8);
+  out.append( (char) (dict.size() & 0xff) );
+  out.append( (char) (dict.size() >> 8) );
+  out.append(dict);
+  return out;
+}
+
+
+static quint32 crc32(quint32 crc, const char * data, qint64 size) {
+  static quint32 table[256];
+  static bool ready = false;
+  if ( ! ready ) {
+    for (quint32 n = 0 ; n < 256 ; n++) {
+      quint32 c = n;
+      for (int k = 0 ; k < 8 ; k++)
+        c = ( c & 1 )  ?  0xEDB88320u ^ (c >> 1)  :  c >> 1 ;
+      table[n] = c;
+    }
+    ready = true;
+  }
+  crc = ~crc;
+  for (qint64 i = 0 ; i < size ; i++)
+    crc = table[(crc ^ (uchar) data[i]) & 0xff] ^ (crc >> 8);
+  return ~crc;
+}
+
+
+static void put16(QByteArray & out, quint16 val) {
+  uchar buf[2];
+  qToLittleEndian(val, buf);
+  out.append((const char*) buf, 2);
+}
+
+static void put32(QByteArray & out, quint32 val) {
+  uchar buf[4];
+  qToLittleEndian(val, buf);
+  out.append((const char*) buf, 4);
+}
+
+
+static inline bool put(QFile & file, const char * data, qint64 size) {
+  return file.write(data, size) == size;
+}
+
+
+static inline void putNumber(QByteArray & out, double val) {
+  char buf[32];
+  const int len = snprintf(buf, sizeof(buf), "%.17g", val);
+  out.append(buf, len);
+}
+
+
+
+Exporter::Format Exporter::format(const QString & fileName) {
+  const QString suffix = QFileInfo(fileName).suffix().toLower();
+  if (suffix == "csv")
+    return Csv;
+  if (suffix == "npy")
+    return Npy;
+  if (suffix == "npz")
+    return Npz;
+  return Dat;
+}
+
+QString Exporter::filters() {
+  return "TimeScan data (*.dat);;"
+         "Comma separated values (*.csv);;"
+         "NumPy array (*.npy);;"
+         "NumPy archive (*.npz);;"
+         "All files (*)";
+}
+
+
+Exporter::Exporter(QObject * parent) :
+  QThread(parent),
+  firstPoint(0),
+  cancelled(0),
+  percent(-1)
+{}
+
+Exporter::~Exporter() {
+  cancel();
+  wait();
+}
+
+
+bool Exporter::exportData(const QString & fileName, const QStringList & _header,
+                          qint64 _firstPoint, const QVector<qint64> & _stamps,
+                          const QList<ExportColumn> & _columns) {
+  if ( isRunning() )
+    return false;
+  _fileName = fileName;
+  source.clear();
+  header = _header;
+  firstPoint = _firstPoint;
+  stamps = _stamps;
+  columns = _columns;
+  cancelled.store(0); // here: a cancel() before run() starts must hold
+  start();
+  return true;
+}
+
+bool Exporter::copyFile(const QString & _source, const QString & fileName) {
+  if ( isRunning() )
+    return false;
+  _fileName = fileName;
+  source = _source;
+  header.clear();
+  stamps.clear();
+  columns.clear();
+  cancelled.store(0);
+  start();
+  return true;
+}
+
+void Exporter::cancel() {
+  cancelled.store(1);
+}
+
+
+bool Exporter::step(qint64 done, qint64 total) {
+  const int pc = total  ?  (int) ( 100 * done / total )  :  100 ;
+  if ( pc != percent ) {
+    percent = pc;
+    emit progress(pc);
+  }
+  return ! cancelled.load();
+}
+
+
+void Exporter::run() {
+
+  _error.clear();
+  percent = -1;
+
+  bool ok;
+  if ( ! source.isEmpty() ) {
+    ok = runCopy();
+  } else {
+    const Format fmt = format(_fileName);
+    if (fmt == Npy)
+      ok = runNpy();
+    else if (fmt == Npz)
+      ok = runNpz();
+    else
+      ok = runText(fmt);
+  }
+
+  if ( ! ok ) {
+    if ( _error.isEmpty() && ! cancelled.load() )
+      _error = "Could not write " + _fileName;
+    QFile::remove(_fileName);
+  }
+
+  // release the data
+  stamps.clear();
+  columns.clear();
+
+}
+
+
+bool Exporter::runCopy() {
+
+  QFile in(source), out(_fileName);
+  if ( ! in.open(QIODevice::ReadOnly) ) {
+    _error = in.errorString();
+    return false;
+  }
+  if ( ! out.open(QIODevice::Truncate | QIODevice::WriteOnly) ) {
+    _error = out.errorString();
+    return false;
+  }
+
+  // the source may still be growing: copy what was there at the start
+  const qint64 total = in.size();
+  qint64 done = 0;
+  QByteArray buf;
+  while ( done < total ) {
+    buf = in.read( qMin<qint64>(textFlush, total - done) );
+    if ( buf.isEmpty() || ! put(out, buf.constData(), buf.size()) ) {
+      _error = out.errorString();
+      return false;
+    }
+    done += buf.size();
+    if ( ! step(done, total) )
+      return false;
+  }
+  return true;
+
+}
+
+
+// The date-time text changes once per second: it is formatted only then and
+// the milliseconds are appended as a number.
+bool Exporter::runText(Format fmt) {
+
+  QFile out(_fileName);
+  if ( ! out.open(QIODevice::Truncate | QIODevice::WriteOnly) ) {
+    _error = out.errorString();
+    return false;
+  }
+
+  const bool csv = fmt == Csv;
+  const QString timeFormat = csv  ?  "yyyy-MM-dd hh:mm:ss"  :  "hh:mm:ss" ;
+  const char separator = csv  ?  ','  :  ' ' ;
+
+  QByteArray buf;
+  buf.reserve(textFlush + 4096);
+  if (csv) {
+    buf.append("time");
+    foreach (ExportColumn col, columns)
+      buf.append(",\"").append(col.name.toUtf8()).append('"');
+    buf.append('\n');
+  } else {
+    foreach (QString line, header)
+      buf.append(line.toUtf8()).append('\n');
+  }
+
+  const qint64 rows = stamps.size();
+  qint64 shownSecond = std::numeric_limits<qint64>::min();
+  QByteArray secondText;
+  char num[32];
+
+  for (qint64 row = 0 ; row < rows ; row++) {
+
+    if ( ! csv ) {
+      const int len = snprintf(num, sizeof(num), "%lld ", (long long) (firstPoint + row));
+      buf.append(num, len);
+    }
+
+    const qint64 msec = stamps[row];
+    const qint64 second = msec >= 0  ?  msec / 1000  :  (msec - 999) / 1000 ;
+    if ( second != shownSecond ) {
+      shownSecond = second;
+      secondText = QDateTime::fromMSecsSinceEpoch(second * 1000).toString(timeFormat).toLatin1();
+    }
+    buf.append(secondText);
+    const int len = snprintf(num, sizeof(num), ".%03d", (int) (msec - second * 1000));
+    buf.append(num, len);
+
+    for (int icol = 0 ; icol < columns.size() ; icol++) {
+      buf.append(separator);
+      putNumber(buf, columns[icol].values[row]);
+    }
+    if ( ! csv )
+      buf.append(' ');
+    buf.append('\n');
+
+    if ( buf.size() >= textFlush ) {
+      if ( ! put(out, buf.constData(), buf.size()) ) {
+        _error = out.errorString();
+        return false;
+      }
+      buf.truncate(0);
+    }
+    if ( row % chunkRows == 0  &&  ! step(row, rows) )
+      return false;
+
+  }
+
+  if ( ! put(out, buf.constData(), buf.size()) ) {
+    _error = out.errorString();
+    return false;
+  }
+  step(rows, rows);
+  return true;
+
+}
+
+
+bool Exporter::runNpy() {
+
+  QFile out(_fileName);
+  if ( ! out.open(QIODevice::Truncate | QIODevice::WriteOnly) ) {
+    _error = out.errorString();
+    return false;
+  }
+
+  const qint64 rows = stamps.size();
+  const qint64 total = rows * ( 1 + columns.size() );
+  const QByteArray head = npyHeader( npyFloat, QString("(%1, %2)").arg(rows).arg(1 + columns.size()),
+                                     true );
+  if ( ! put(out, head.constData(), head.size()) ) {
+    _error = out.errorString();
+    return false;
+  }
+
+  // the time column is the only one which needs a conversion
+  QVector<double> converted( (int) qMin(rows, chunkElements) );
+  for (qint64 done = 0 ; done < rows ; done += chunkElements) {
+    const qint64 count = qMin(chunkElements, rows - done);
+    for (qint64 idx = 0 ; idx < count ; idx++)
+      converted[idx] = stamps[done + idx];
+    if ( ! put(out, (const char*) converted.constData(), count * sizeof(double)) ) {
+      _error = out.errorString();
+      return false;
+    }
+    if ( ! step(done + count, total) )
+      return false;
+  }
+
+  for (int icol = 0 ; icol < columns.size() ; icol++) {
+    const double * data = columns[icol].values.constData();
+    for (qint64 done = 0 ; done < rows ; done += chunkElements) {
+      const qint64 count = qMin(chunkElements, rows - done);
+      if ( ! put(out, (const char*) (data + done), count * sizeof(double)) ) {
+        _error = out.errorString();
+        return false;
+      }
+      if ( ! step( (icol + 1) * rows + done + count, total) )
+        return false;
+    }
+  }
+
+  return true;
+
+}
+
+
+// Stored (uncompressed) zip: the CRC of every entry is calculated from the
+// data in memory before its local header is written, so no data descriptors
+// or seeking back are needed.
+bool Exporter::runNpz() {
+
+  QFile out(_fileName);
+  if ( ! out.open(QIODevice::Truncate | QIODevice::WriteOnly) ) {
+    _error = out.errorString();
+    return false;
+  }
+
+  const qint64 rows = stamps.size();
+  const qint64 total = rows * ( 1 + columns.size() );
+  const QString shape = QString("(%1,)").arg(rows);
+
+  const QDateTime now = QDateTime::currentDateTime();
+  const quint16 dosTime = ( now.time().hour() << 11 ) | ( now.time().minute() << 5 )
+                          | ( now.time().second() / 2 );
+  const quint16 dosDate = ( ( now.date().year() - 1980 ) << 9 ) | ( now.date().month() << 5 )
+                          | now.date().day();
+
+  QByteArray central;
+  quint64 offset = 0;
+  const int entries = 1 + columns.size();
+  QSet<QString> names; // of the entries so far: numpy keeps one per name
+
+  for (int entry = 0 ; entry < entries ; entry++) {
+
+    QString name;
+    const char * data;
+    if (entry == 0) {
+      name = "time";
+      data = (const char*) stamps.constData();
+    } else {
+      name = columns[entry-1].name;
+      name.replace(QRegExp("[^A-Za-z0-9_:.+-]"), "_");
+      data = (const char*) columns[entry-1].values.constData();
+    }
+    // names which are the same once sanitized, or "time", get a suffix
+    const QString base = name;
+    for (int suffix = 2 ; names.contains(name) ; suffix++)
+      name = base + "_" + QString::number(suffix);
+    names << name;
+    const QByteArray entryName = (name + ".npy").toUtf8();
+    const QByteArray head = npyHeader(entry ? npyFloat : npyInt, shape, false);
+    const quint64 size = head.size() + rows * 8;
+    const quint64 localSize = 30 + entryName.size(); // the local header
+    if ( size > 0xFFFFFFFFu || offset + localSize + size > 0xFFFFFFFFu ) {
+      _error = "The data is too large for a .npz archive; export to .npy instead.";
+      return false;
+    }
+
+    quint32 crc = crc32(0, head.constData(), head.size());
+    for (qint64 done = 0 ; done < rows ; done += chunkElements) {
+      crc = crc32(crc, data + done * 8, qMin(chunkElements, rows - done) * 8);
+      if ( cancelled.load() )
+        return false;
+    }
+
+    QByteArray local;
+    put32(local, 0x04034b50);
+    put16(local, 20);         // version needed
+    put16(local, 0);          // flags
+    put16(local, 0);          // stored
+    put16(local, dosTime);
+    put16(local, dosDate);
+    put32(local, crc);
+    put32(local, size);       // compressed
+    put32(local, size);       // uncompressed
+    put16(local, entryName.size());
+    put16(local, 0);          // extra
+    local.append(entryName);
+
+    put32(central, 0x02014b50);
+    put16(central, 20);       // version made by
+    put16(central, 20);       // version needed
+    put16(central, 0);
+    put16(central, 0);
+    put16(central, dosTime);
+    put16(central, dosDate);
+    put32(central, crc);
+    put32(central, size);
+    put32(central, size);
+    put16(central, entryName.size());
+    put16(central, 0);        // extra
+    put16(central, 0);        // comment
+    put16(central, 0);        // disk
+    put16(central, 0);        // internal attributes
+    put32(central, 0);        // external attributes
+    put32(central, offset);
+    central.append(entryName);
+
+    if ( ! put(out, local.constData(), local.size()) ||
+         ! put(out, head.constData(), head.size()) ) {
+      _error = out.errorString();
+      return false;
+    }
+    for (qint64 done = 0 ; done < rows ; done += chunkElements) {
+      const qint64 count = qMin(chunkElements, rows - done);
+      if ( ! put(out, data + done * 8, count * 8) ) {
+        _error = out.errorString();
+        return false;
+      }
+      if ( ! step(entry * rows + done + count, total) )
+        return false;
+    }
+    offset += local.size() + size;
+
+  }
+
+  QByteArray end;
+  put32(end, 0x06054b50);
+  put16(end, 0);              // disk
+  put16(end, 0);              // disk with the directory
+  put16(end, entries);
+  put16(end, entries);
+  put32(end, central.size());
+  put32(end, offset);
+  put16(end, 0);              // comment
+  if ( ! put(out, central.constData(), central.size()) ||
+       ! put(out, end.constData(), end.size()) ) {
+    _error = out.errorString();
+    return false;
+  }
+  step(total, total);
+  return true;
+
+}
@@ -0,0 +1,94 @@
+#ifndef EXPORTER_H
+#define EXPORTER_H
+
+#include <QThread>
+#include <QAtomicInt>
+#include <QStringList>
+#include <QVector>
+#include <QList>
+
+
+// One column of the exported data, oldest sample first.
+struct ExportColumn {
+  QString name;
+  QVector<double> values;
+};
+
+
+// Writes the data on its own thread so that large exports do not block the
+// GUI. The columns are handed over as implicitly shared vectors which the
+// caller does not touch afterwards; the writer streams them to the file in
+// chunks, reporting the progress and checking for cancellation between them.
+// Formats, chosen by the file suffix:
+//  .dat - layout of the TimeScan data file: header lines, then
+//         "point hh:mm:ss.zzz values";
+//  .csv - "time,<names>" header, ISO date-time and full precision values;
+//  .npy - one float64 array of shape (rows, 1+columns) in Fortran order, so
+//         that every column is written straight from its vector; the first
+//         column holds the time in ms since epoch;
+//  .npz - uncompressed zip with "time.npy" (int64 ms since epoch) and one
+//         float64 "<name>.npy" per column, as read by numpy.load().
+// A failed or cancelled export removes the incomplete file.
+class Exporter : public QThread {
+  Q_OBJECT;
+
+public:
+
+  enum Format {
+    Dat,
+    Csv,
+    Npy,
+    Npz
+  };
+
+  static Format format(const QString & fileName);
+  static QString filters(); // for QFileDialog
+
+  Exporter(QObject * parent=0);
+  ~Exporter();
+
+  // false if an export is already running
+  bool exportData(const QString & fileName, const QStringList & header,
+                  qint64 firstPoint, const QVector<qint64> & stamps,
+                  const QList<ExportColumn> & columns);
+  bool copyFile(const QString & source, const QString & fileName);
+
+  inline const QString & fileName() const {return _fileName;}
+  inline const QString & error() const {return _error;} // empty on success
+  inline bool wasCancelled() const {return cancelled.load();}
+
+public slots:
+
+  void cancel();
+
+signals:
+
+  void progress(int percent);
+
+protected:
+
+  virtual void run();
+
+private:
+
+  QString _fileName;
+  QString source; // file to copy, empty for the column export
+  QStringList header;
+  qint64 firstPoint;
+  QVector<qint64> stamps;
+  QList<ExportColumn> columns;
+  QString _error;
+  QAtomicInt cancelled;
+  int percent;
+
+  bool step(qint64 done, qint64 total); // reports progress, false if cancelled
+
+  bool runCopy();
+  bool runText(Format fmt);
+  bool runNpy();
+  bool runNpz();
+
+};
+
+
+#endif // EXPORTER_H
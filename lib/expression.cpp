@@ -0,0 +1,273 @@
+#include <math.h>
+
+#include "expression.h"
+
+
+enum Func {
+  Abs,
+  Sqrt,
+  Exp,
+  Log,
+  Log10,
+  Sin,
+  Cos,
+  Tan,
+  Functions
+};
+
+static const char * const functionNames[Functions] =
+  {"abs", "sqrt", "exp", "log", "log10", "sin", "cos", "tan"};
+
+static inline bool isNameChar(QChar ch) {
+  return ch.isLetterOrNumber() || ch == '_' || ch == ':' || ch == '.';
+}
+
+
+
+Expression::Expression() :
+  pos(0)
+{}
+
+
+bool Expression::fail(const QString & msg) {
+  _error = QString("%1 at position %2").arg(msg).arg(pos + 1);
+  return false;
+}
+
+
+void Expression::emitOp(OpCode opc, int arg, double value) {
+  Op op;
+  op.code = opc;
+  op.arg = arg;
+  op.value = value;
+  code << op;
+}
+
+
+void Expression::skipSpaces() {
+  while ( pos < text.size() && text[pos].isSpace() )
+    pos++;
+}
+
+
+bool Expression::compile(const QString & _text) {
+
+  code.clear();
+  stack.clear();
+  _inputs.clear();
+  _error.clear();
+  text = _text;
+  pos = 0;
+
+  bool ok = parseSum();
+  skipSpaces();
+  if ( ok && pos < text.size() )
+    ok = fail("Unexpected \"" + text.mid(pos, 1) + "\"");
+  if ( ! ok ) {
+    code.clear();
+    _inputs.clear();
+    return false;
+  }
+
+  // the depth of the stack is known from the code
+  int depth = 0, maxDepth = 0;
+  foreach (Op op, code) {
+    if ( op.code == Constant || op.code == Input )
+      depth++;
+    else if ( op.code != Negate && op.code != Function )
+      depth--;
+    maxDepth = qMax(depth, maxDepth);
+  }
+  stack.resize(maxDepth);
+  return true;
+
+}
+
+
+bool Expression::parseSum() {
+  if ( ! parseProduct() )
+    return false;
+  forever {
+    skipSpaces();
+    if ( pos >= text.size() || ( text[pos] != '+' && text[pos] != '-' ) )
+      return true;
+    const OpCode opc = text[pos] == '+'  ?  Add  :  Subtract ;
+    pos++;
+    if ( ! parseProduct() )
+      return false;
+    emitOp(opc);
+  }
+}
+
+
+bool Expression::parseProduct() {
+  if ( ! parseUnary() )
+    return false;
+  forever {
+    skipSpaces();
+    if ( pos >= text.size() || ( text[pos] != '*' && text[pos] != '/' ) )
+      return true;
+    const OpCode opc = text[pos] == '*'  ?  Multiply  :  Divide ;
+    pos++;
+    if ( ! parseUnary() )
+      return false;
+    emitOp(opc);
+  }
+}
+
+
+// Unary minus binds looser than the power: -2^2 is -4, while 2^-1 is 0.5.
+bool Expression::parseUnary() {
+  skipSpaces();
+  if ( pos < text.size() && text[pos] == '-' ) {
+    pos++;
+    if ( ! parseUnary() )
+      return false;
+    emitOp(Negate);
+    return true;
+  }
+  if ( pos < text.size() && text[pos] == '+' ) {
+    pos++;
+    return parseUnary();
+  }
+  return parsePower();
+}
+
+
+bool Expression::parsePower() {
+  if ( ! parsePrimary() )
+    return false;
+  skipSpaces();
+  if ( pos < text.size() && text[pos] == '^' ) {
+    pos++;
+    if ( ! parseUnary() ) // right associative
+      return false;
+    emitOp(Power);
+  }
+  return true;
+}
+
+
+bool Expression::parsePrimary() {
+
+  skipSpaces();
+  if ( pos >= text.size() )
+    return fail("Unexpected end");
+  const QChar ch = text[pos];
+
+  if ( ch == '(' ) {
+    pos++;
+    if ( ! parseSum() )
+      return false;
+    skipSpaces();
+    if ( pos >= text.size() || text[pos] != ')' )
+      return fail("Missing \")\"");
+    pos++;
+    return true;
+  }
+
+  if ( ch.isDigit() || ch == '.' ) {
+    int end = pos;
+    while ( end < text.size() && ( text[end].isDigit() || text[end] == '.' ) )
+      end++;
+    if ( end < text.size() && ( text[end] == 'e' || text[end] == 'E' ) ) {
+      int exp = end + 1;
+      if ( exp < text.size() && ( text[exp] == '+' || text[exp] == '-' ) )
+        exp++;
+      if ( exp < text.size() && text[exp].isDigit() ) {
+        end = exp;
+        while ( end < text.size() && text[end].isDigit() )
+          end++;
+      }
+    }
+    bool ok;
+    const double value = text.mid(pos, end - pos).toDouble(&ok);
+    if ( ! ok )
+      return fail("Bad number");
+    pos = end;
+    emitOp(Constant, 0, value);
+    return true;
+  }
+
+  QString name;
+  if ( ch == '{' ) {
+    const int close = text.indexOf('}', pos);
+    if ( close < 0 )
+      return fail("Missing \"}\"");
+    name = text.mid(pos + 1, close - pos - 1).trimmed();
+    pos = close + 1;
+    if ( name.isEmpty() )
+      return fail("Empty name");
+  } else if ( isNameChar(ch) ) {
+    const int start = pos;
+    while ( pos < text.size() && isNameChar(text[pos]) )
+      pos++;
+    name = text.mid(start, pos - start);
+    skipSpaces();
+    if ( pos < text.size() && text[pos] == '(' ) {
+      int func = 0;
+      while ( func < Functions && name != functionNames[func] )
+        func++;
+      if ( func == Functions )
+        return fail("Unknown function \"" + name + "\"");
+      pos++;
+      if ( ! parseSum() )
+        return false;
+      skipSpaces();
+      if ( pos >= text.size() || text[pos] != ')' )
+        return fail("Missing \")\"");
+      pos++;
+      emitOp(Function, func);
+      return true;
+    }
+  } else {
+    return fail("Unexpected \"" + QString(ch) + "\"");
+  }
+
+  int input = _inputs.indexOf(name);
+  if ( input < 0 ) {
+    input = _inputs.size();
+    _inputs << name;
+  }
+  emitOp(Input, input);
+  return true;
+
+}
+
+
+double Expression::evaluate(const double * values) const {
+
+  if ( code.isEmpty() )
+    return NAN;
+
+  double * st = stack.data();
+  int top = -1;
+  const Op * op = code.constData();
+  const Op * end = op + code.size();
+  for ( ; op < end ; op++ ) {
+    switch (op->code) {
+      case Constant: st[++top] = op->value;          break;
+      case Input:    st[++top] = values[op->arg];    break;
+      case Negate:   st[top] = - st[top];            break;
+      case Add:      top--; st[top] += st[top+1];    break;
+      case Subtract: top--; st[top] -= st[top+1];    break;
+      case Multiply: top--; st[top] *= st[top+1];    break;
+      case Divide:   top--; st[top] /= st[top+1];    break;
+      case Power:    top--; st[top] = pow(st[top], st[top+1]); break;
+      case Function:
+        switch (op->arg) {
+          case Abs:   st[top] = fabs(st[top]);  break;
+          case Sqrt:  st[top] = sqrt(st[top]);  break;
+          case Exp:   st[top] = exp(st[top]);   break;
+          case Log:   st[top] = log(st[top]);   break;
+          case Log10: st[top] = log10(st[top]); break;
+          case Sin:   st[top] = sin(st[top]);   break;
+          case Cos:   st[top] = cos(st[top]);   break;
+          case Tan:   st[top] = tan(st[top]);   break;
+        }
+        break;
+    }
+  }
+  return st[0];
+
+}
@@ -0,0 +1,73 @@
+#ifndef EXPRESSION_H
+#define EXPRESSION_H
+
+#include <QString>
+#include <QStringList>
+#include <QVector>
+
+
+// Arithmetic expression over named inputs, compiled once into postfix code
+// and evaluated on a stack allocated at compile time, so evaluation does
+// not allocate.
+//
+// Grammar: + - * / ^ (right associative), unary minus (looser than ^, so
+// -2^2 is -4), parentheses, numbers, the functions abs sqrt exp log log10
+// sin cos tan, and inputs: names made of letters, digits and _ : . or, for
+// names with other characters such as '-', any text in braces:
+// {SR08ID01:I-0}.
+class Expression {
+
+public:
+
+  Expression();
+
+  bool compile(const QString & text); // false with error() on a syntax error
+  inline const QString & error() const {return _error;}
+  inline bool isValid() const {return ! code.isEmpty();}
+
+  // distinct inputs in order of the first appearance: the order of the
+  // values given to evaluate()
+  inline const QStringList & inputs() const {return _inputs;}
+  double evaluate(const double * values) const;
+
+private:
+
+  enum OpCode {
+    Constant,
+    Input,
+    Negate,
+    Add,
+    Subtract,
+    Multiply,
+    Divide,
+    Power,
+    Function
+  };
+
+  struct Op {
+    OpCode code;
+    int arg; // input index or function
+    double value;
+  };
+
+  QVector<Op> code;
+  mutable QVector<double> stack;
+  QStringList _inputs;
+  QString _error;
+
+  // recursive descent parser state
+  QString text;
+  int pos;
+  void skipSpaces();
+  bool parseSum();
+  bool parseProduct();
+  bool parsePower();
+  bool parseUnary();
+  bool parsePrimary();
+  void emitOp(OpCode opc, int arg=0, double value=0.0);
+  bool fail(const QString & msg);
+
+};
+
+
+#endif // EXPRESSION_H
@@ -0,0 +1,72 @@
+#include <math.h>
+
+#include "fft.h"
+
+
+int FFT::size(int atLeast) {
+  int sz = 1;
+  while ( sz < atLeast )
+    sz <<= 1;
+  return sz;
+}
+
+
+FFT::FFT(int _n) :
+  n(0)
+{
+  resize(_n);
+}
+
+
+void FFT::resize(int _n) {
+  if ( _n == n )
+    return;
+  n = _n;
+  reversed.resize(n);
+  twiddles.resize(n / 2);
+  int bits = 0;
+  while ( (1 << bits) < n )
+    bits++;
+  for (int idx = 0 ; idx < n ; idx++) {
+    int rev = 0;
+    for (int bit = 0 ; bit < bits ; bit++)
+      if ( idx & (1 << bit) )
+        rev |= 1 << (bits - 1 - bit);
+    reversed[idx] = rev;
+  }
+  for (int k = 0 ; k < n / 2 ; k++)
+    twiddles[k] = std::polar(1.0, -2.0 * M_PI * k / n);
+}
+
+
+void FFT::forward(Complex * data) const {
+  transform(data, false);
+}
+
+
+void FFT::inverse(Complex * data) const {
+  transform(data, true);
+  const double scale = 1.0 / n;
+  for (int idx = 0 ; idx < n ; idx++)
+    data[idx] *= scale;
+}
+
+
+void FFT::transform(Complex * data, bool inv) const {
+
+  for (int idx = 0 ; idx < n ; idx++)
+    if ( idx < reversed[idx] )
+      std::swap(data[idx], data[reversed[idx]]);
+
+  for (int len = 2 ; len <= n ; len <<= 1) {
+    const int half = len / 2, step = n / len;
+    for (int start = 0 ; start < n ; start += len)
+      for (int k = 0 ; k < half ; k++) {
+        const Complex tw = inv  ?  std::conj(twiddles[k * step])  :  twiddles[k * step] ;
+        const Complex odd = tw * data[start + k + half];
+        data[start + k + half] = data[start + k] - odd;
+        data[start + k] += odd;
+      }
+  }
+
+}
@@ -0,0 +1,39 @@
+#ifndef FFT_H
+#define FFT_H
+
+#include <complex>
+#include <QVector>
+
+
+typedef std::complex<double> Complex;
+
+
+// In-place radix-2 complex FFT of a fixed power-of-two size. The bit
+// reversal and the twiddle factors are tabulated once per size, so that
+// repeated transforms (averaged segments, lag scans) cost only the
+// butterflies.
+class FFT {
+
+public:
+
+  static int size(int atLeast); // smallest power of two not less than atLeast
+
+  FFT(int n=0); // n must be a power of two
+  void resize(int n);
+  inline int size() const {return n;}
+
+  void forward(Complex * data) const;
+  void inverse(Complex * data) const; // scaled by 1/n
+
+private:
+
+  int n;
+  QVector<int> reversed;
+  QVector<Complex> twiddles; // exp(-2 pi i k / n), k < n/2
+
+  void transform(Complex * data, bool inv) const;
+
+};
+
+
+#endif // FFT_H
@@ -0,0 +1,201 @@
+#include <QDebug>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QAtomicInt>
+#include <math.h>
+
+#include "groupread.h"
+#include "pvpool.h"
+
+
+
+// One grouped get in flight. It is shared by the owner and by every get
+// still outstanding, and freed by whichever lets it go last: the replies
+// of an abandoned request (timed out, cancelled or its owner gone) may
+// still come in on the CA threads.
+struct GroupRequest;
+
+struct GroupTarget {
+  GroupRequest * request;
+  int index;
+};
+
+struct GroupRequest {
+  QMutex lock;
+  QAtomicInt refs;
+  GroupRead * owner; // 0 once abandoned
+  int remaining; // replies still awaited
+  QVector<double> values;
+  QVector<GroupTarget> targets; // the user data of the gets
+};
+
+
+static void releaseRequest(GroupRequest * req) {
+  if ( ! req->refs.deref() )
+    delete req;
+}
+
+
+#ifdef TIMESCAN_GROUPREAD
+
+// On a CA thread.
+static void gotValue(struct event_handler_args args) {
+  const GroupTarget * target = static_cast<const GroupTarget*>(args.usr);
+  GroupRequest * req = target->request;
+  {
+    QMutexLocker locker(&req->lock);
+    if ( args.status == ECA_NORMAL && args.dbr )
+      req->values[target->index] = *static_cast<const dbr_double_t*>(args.dbr);
+    if ( ! --req->remaining && req->owner )
+      QMetaObject::invokeMethod(req->owner, "complete", Qt::QueuedConnection);
+  }
+  releaseRequest(req);
+}
+
+#endif
+
+
+
+
+GroupRead::GroupRead(QObject * parent) :
+  QObject(parent),
+  pending(0)
+{
+  timer.setSingleShot(true);
+  connect(&timer, SIGNAL(timeout()), SLOT(expire()));
+}
+
+GroupRead::~GroupRead() {
+  setPVs(QStringList());
+}
+
+bool GroupRead::isAvailable() {
+  #ifdef TIMESCAN_GROUPREAD
+  return true;
+  #else
+  return false;
+  #endif
+}
+
+
+// The channels are created without waiting for them: the ones not
+// connected yet are left out of the gets and read as NaN.
+void GroupRead::setPVs(const QStringList & pvs) {
+
+  if ( pvs == _pvs && channels.size() == pvs.size() )
+    return;
+  cancel();
+  _pvs = pvs;
+  _values.fill(NAN, pvs.size());
+
+  #ifdef TIMESCAN_GROUPREAD
+  foreach (void * ch, channels)
+    PvPool::releaseChannel(static_cast<chid>(ch));
+  channels.fill(0, pvs.size());
+  for ( int idx = 0 ; idx < pvs.size() ; idx++ ) // empty names stay NaN
+    channels[idx] = PvPool::acquireChannel(pvs[idx]);
+  #endif
+
+}
+
+
+bool GroupRead::request(double timeout) {
+
+  requested = QDateTime::currentDateTime();
+  if (pending)
+    return false;
+  _values.fill(NAN, _pvs.size());
+
+  #ifdef TIMESCAN_GROUPREAD
+
+  QList<int> connected;
+  for ( int idx = 0 ; idx < channels.size() ; idx++ )
+    if ( channels[idx] && ca_state(static_cast<chid>(channels[idx])) == cs_conn )
+      connected << idx;
+  if ( connected.isEmpty() )
+    return false;
+
+  // The count is complete before the first get goes out, so that no reply
+  // can find it at zero too early.
+  GroupRequest * req = new GroupRequest;
+  req->owner = this;
+  req->refs.store(1 + connected.size());
+  req->remaining = connected.size();
+  req->values.fill(NAN, channels.size());
+  req->targets.resize(channels.size());
+  int issued = 0;
+  foreach (int idx, connected) {
+    req->targets[idx].request = req;
+    req->targets[idx].index = idx;
+    if ( ca_array_get_callback(DBR_DOUBLE, 1, static_cast<chid>(channels[idx]),
+                               gotValue, &req->targets[idx]) == ECA_NORMAL ) {
+      issued++;
+    } else {
+      QMutexLocker locker(&req->lock);
+      req->remaining--;
+      req->refs.deref(); // the owner's reference is still there
+    }
+  }
+  ca_flush_io();
+
+  if ( ! issued ) {
+    releaseRequest(req);
+    return false;
+  }
+  pending = req;
+  {
+    QMutexLocker locker(&req->lock);
+    if ( ! req->remaining ) // all in already, or the last get failed
+      QMetaObject::invokeMethod(this, "complete", Qt::QueuedConnection);
+  }
+  timer.start( qMax(1, (int) ( 1000 * timeout )) );
+  return true;
+
+  #else
+  Q_UNUSED(timeout);
+  return false;
+  #endif
+
+}
+
+
+void GroupRead::cancel() {
+  timer.stop();
+  if ( ! pending )
+    return;
+  {
+    QMutexLocker locker(&pending->lock);
+    pending->owner = 0;
+  }
+  releaseRequest(pending);
+  pending = 0;
+}
+
+
+void GroupRead::complete() {
+  if ( ! pending )
+    return; // posted by a request given up since
+  {
+    QMutexLocker locker(&pending->lock);
+    if ( pending->remaining )
+      return; // posted by a request given up since
+  }
+  finish();
+}
+
+
+void GroupRead::expire() {
+  if (pending)
+    finish();
+}
+
+
+// the values which did not arrive stay NaN
+void GroupRead::finish() {
+  {
+    QMutexLocker locker(&pending->lock);
+    _values = pending->values;
+  }
+  cancel();
+  emit ready();
+}
@@ -0,0 +1,62 @@
+#ifndef GROUPREAD_H
+#define GROUPREAD_H
+
+#include <QObject>
+#include <QStringList>
+#include <QVector>
+#include <QDateTime>
+#include <QTimer>
+
+
+// Coherent snapshot of several PVs: one Channel Access get with a callback
+// is queued for every channel and all of them are flushed at once, so a row
+// costs a single network round-trip. Nothing blocks: ready() is emitted once
+// the last reply has arrived or the timeout has expired, whichever comes
+// first; values which did not arrive by then are NaN. The channels are the
+// plain CA channels of PvPool, shared with the other charts.
+// Available only if the library was built against the EPICS CA headers.
+struct GroupRequest;
+class GroupRead : public QObject {
+  Q_OBJECT;
+
+public:
+
+  GroupRead(QObject * parent=0);
+  ~GroupRead();
+
+  static bool isAvailable();
+
+  void setPVs(const QStringList & pvs);
+  inline const QStringList & pvs() const {return _pvs;}
+
+  // false if nothing was requested (no channel connected, or the previous
+  // get still pending): ready() is not emitted then
+  bool request(double timeout);
+  void cancel();
+  inline bool isPending() const {return pending;}
+  inline const QDateTime & requestTime() const {return requested;}
+  inline const QVector<double> & values() const {return _values;}
+
+signals:
+
+  void ready();
+
+private slots:
+
+  void complete(); // from the CA callbacks, queued
+  void expire();
+
+private:
+
+  QStringList _pvs;
+  QVector<void*> channels; // chid
+  QVector<double> _values;
+  GroupRequest * pending;
+  QDateTime requested;
+  QTimer timer;
+  void finish();
+
+};
+
+
+#endif // GROUPREAD_H
@@ -0,0 +1,260 @@
+#include <QTime>
+#include <QFileInfo>
+#include <math.h>
+
+#include "history.h"
+
+
+static const qint64 msPerDay = 24 * 3600 * 1000;
+static const qint64 defaultCache = 32 << 20; // bytes
+
+
+QString HistoryIndex::fileName(const QString & dataFileName) {
+  return dataFileName + ".idx";
+}
+
+
+HistoryIndex::HistoryIndex() :
+  signalsCount(0),
+  offset(0),
+  rows(0),
+  firstPoint(0),
+  firstX(NAN),
+  lastX(NAN)
+{}
+
+
+bool HistoryIndex::open(const QString & dataFileName, const QStringList & names,
+                        int stride, bool timestamped, qint64 dataOffset) {
+  if ( file.isOpen() )
+    file.close();
+  file.setFileName(fileName(dataFileName));
+  if ( ! file.open(QIODevice::Truncate | QIODevice::WriteOnly) )
+    return false;
+  stream.setDevice(&file);
+  stream.setRealNumberPrecision(17);
+  signalsCount = names.size();
+  offset = dataOffset;
+  rows = 0;
+  QStringList columns;
+  foreach (QString name, names)
+    columns << QString(name).remove(' ');
+  stream
+      << "# TimeScan chunk index of " << QFileInfo(dataFileName).fileName() << "\n"
+      << "# axis: " << ( timestamped ? "time" : "index" ) << "\n"
+      << "# stride: " << stride << "\n"
+      << "# signals: " << columns.join(" ") << "\n";
+  stream.flush();
+  return true;
+}
+
+
+void HistoryIndex::close(qint64 dataEnd) {
+  if ( ! file.isOpen() )
+    return;
+  closeChunk(dataEnd);
+  file.close();
+}
+
+
+bool HistoryIndex::add(int point, double x, const QVector<double> & values) {
+  if ( ! file.isOpen() )
+    return false;
+  if ( ! rows ) {
+    firstPoint = point;
+    firstX = x;
+    mins.fill(NAN, signalsCount);
+    maxs.fill(NAN, signalsCount);
+  }
+  lastX = x;
+  for (int sig = 0 ; sig < signalsCount && sig < values.size() ; sig++) {
+    const double val = values[sig];
+    if ( isnan(val) )
+      continue;
+    if ( isnan(mins[sig]) || val < mins[sig] )
+      mins[sig] = val;
+    if ( isnan(maxs[sig]) || val > maxs[sig] )
+      maxs[sig] = val;
+  }
+  return ++rows >= chunkRows;
+}
+
+
+void HistoryIndex::closeChunk(qint64 dataEnd) {
+  if ( ! file.isOpen() || ! rows )
+    return;
+  stream << offset << " " << dataEnd - offset << " " << rows << " "
+         << firstPoint << " " << firstX << " " << lastX;
+  for (int sig = 0 ; sig < signalsCount ; sig++)
+    stream << " " << mins[sig] << " " << maxs[sig];
+  stream << "\n";
+  stream.flush();
+  offset = dataEnd;
+  rows = 0;
+}
+
+
+
+
+History::History() :
+  indexSize(0),
+  timestamped(false),
+  stride(1)
+{
+  setCacheSize(defaultCache);
+}
+
+
+void History::setCacheSize(qint64 bytes) {
+  cache.setMaxCost( qMax<qint64>(1, bytes >> 10) ); // in kB
+}
+
+
+void History::close() {
+  dataName.clear();
+  indexSize = 0;
+  names.clear();
+  index.clear();
+  cache.clear();
+}
+
+
+static double number(const QString & str) {
+  bool ok;
+  const double val = str.toDouble(&ok);
+  return ok  ?  val  :  NAN ;
+}
+
+
+bool History::open(const QString & dataFileName) {
+
+  QFile file(HistoryIndex::fileName(dataFileName));
+  if ( ! file.open(QIODevice::ReadOnly) ) {
+    close();
+    return false;
+  }
+  // a new scan into the same file starts a new index
+  if ( dataFileName != dataName || file.size() < indexSize ) {
+    close();
+    dataName = dataFileName;
+  }
+  if ( file.size() == indexSize )
+    return true;
+  indexSize = file.size();
+
+  // the chunks already read do not change: only the new lines are parsed
+  const int known = index.size();
+  int line = 0;
+  QTextStream stream(&file);
+  while ( ! stream.atEnd() ) {
+    const QString text = stream.readLine();
+    if ( text.startsWith('#') ) {
+      if ( text.startsWith("# axis: ") )
+        timestamped = text.mid(8).trimmed() == "time";
+      else if ( text.startsWith("# stride: ") )
+        stride = qMax(1, text.mid(10).trimmed().toInt());
+      else if ( text.startsWith("# signals: ") )
+        names = text.mid(11).split(' ', QString::SkipEmptyParts);
+      continue;
+    }
+    if ( line++ < known )
+      continue;
+    const QStringList fields = text.split(' ', QString::SkipEmptyParts);
+    if ( fields.size() != 6 + 2 * names.size() )
+      break; // incomplete line being written
+    HistoryChunk chk;
+    chk.offset = fields[0].toLongLong();
+    chk.bytes = fields[1].toLongLong();
+    chk.rows = fields[2].toInt();
+    chk.firstPoint = fields[3].toInt();
+    chk.firstX = number(fields[4]);
+    chk.lastX = number(fields[5]);
+    for (int sig = 0 ; sig < names.size() ; sig++) {
+      chk.mins << number(fields[6 + 2 * sig]);
+      chk.maxs << number(fields[7 + 2 * sig]);
+    }
+    index << chk;
+  }
+  return true;
+
+}
+
+
+// The chunks are in the order of x: binary search for the first one
+// reaching x0.
+QList<int> History::chunksIn(double x0, double x1) const {
+  int lo = 0, hi = index.size();
+  while ( lo < hi ) {
+    const int mid = (lo + hi) / 2;
+    if ( index[mid].lastX < x0 )
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  QList<int> found;
+  for (int idx = lo ; idx < index.size() && index[idx].firstX <= x1 ; idx++)
+    found << idx;
+  return found;
+}
+
+
+const HistoryRows * History::rows(int idx) {
+  if ( idx < 0 || idx >= index.size() )
+    return 0;
+  if ( ! cache.contains(idx) ) {
+    HistoryRows * rws = read(index[idx]);
+    if ( ! rws )
+      return 0;
+    const int cost = 1 + (int) ( ( rws->x.size() + rws->values.size() ) * sizeof(double) >> 10 );
+    cache.insert(idx, rws, cost);
+  }
+  return cache.object(idx);
+}
+
+
+// Rows are "point hh:mm:ss.zzz value [aggregates] value ...": the time of the
+// day is turned back into ms since epoch from the first x of the chunk.
+HistoryRows * History::read(const HistoryChunk & chk) {
+
+  QFile file(dataName);
+  if ( ! file.open(QIODevice::ReadOnly) || ! file.seek(chk.offset) )
+    return 0;
+  const QByteArray bytes = file.read(chk.bytes);
+  if ( bytes.size() != chk.bytes )
+    return 0;
+
+  HistoryRows * rws = new HistoryRows;
+  rws->x.reserve(chk.rows);
+  rws->values.reserve(chk.rows * names.size());
+  int firstTod = -1;
+  QVector<double> held(names.size(), NAN); // recorded last
+  foreach (QByteArray line, bytes.split('\n')) {
+    const QStringList fields = QString::fromUtf8(line).split(' ', QString::SkipEmptyParts);
+    bool ok;
+    const int point = fields.value(0).toInt(&ok);
+    if ( ! ok || fields.size() < 2 + names.size() * stride )
+      continue; // comment or script output
+    double x;
+    if (timestamped) {
+      const int tod = QTime::fromString(fields[1], "hh:mm:ss.zzz").msecsSinceStartOfDay();
+      if ( firstTod < 0 )
+        firstTod = tod;
+      x = chk.firstX + ( tod - firstTod + msPerDay ) % msPerDay;
+    } else {
+      x = chk.firstX + point - chk.firstPoint;
+    }
+    rws->x << x;
+    for (int sig = 0 ; sig < names.size() ; sig++) {
+      const QString & field = fields[2 + sig * stride];
+      if ( field == "-" ) {
+        rws->values << NAN;
+        continue;
+      }
+      if ( field != "=" )
+        held[sig] = number(field);
+      rws->values << held[sig];
+    }
+  }
+  return rws;
+
+}
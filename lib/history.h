@@ -0,0 +1,122 @@
+#ifndef HISTORY_H
+#define HISTORY_H
+
+#include <QFile>
+#include <QTextStream>
+#include <QStringList>
+#include <QVector>
+#include <QCache>
+
+
+// Chunk index written next to the data file ("<data file>.idx") so that the
+// rows which have left the window can be found again without reading the
+// whole file. Every line describes chunkRows consecutive rows:
+//   offset bytes rows firstPoint firstX lastX min0 max0 min1 max1 ...
+// with the byte range of the rows in the data file, the number of the first
+// row, the x coordinate (ms since epoch on the real time axis, sample index
+// otherwise) of the first and last rows and the range of every signal. It
+// follows a few header lines starting with '#':
+//   # axis: time|index
+//   # stride: <columns per signal in the data file>
+//   # signals: <names>
+class HistoryIndex {
+
+public:
+
+  static const int chunkRows = 1024;
+  static QString fileName(const QString & dataFileName);
+
+  HistoryIndex();
+
+  // dataOffset is where the first row will be written
+  bool open(const QString & dataFileName, const QStringList & names,
+            int stride, bool timestamped, qint64 dataOffset);
+  void close(qint64 dataEnd); // writes the incomplete chunk
+  inline bool isOpen() const {return file.isOpen();}
+
+  // true once the chunk is complete: the caller then flushes the data file
+  // and closes the chunk at its current size
+  bool add(int point, double x, const QVector<double> & values);
+  // no row in the current chunk yet: the recorder then starts its deadbands
+  // over, so that every chunk can be read on its own
+  inline bool isChunkStart() const {return file.isOpen() && ! rows;}
+  void closeChunk(qint64 dataEnd);
+
+private:
+
+  QFile file;
+  QTextStream stream;
+  int signalsCount;
+  qint64 offset;
+  int rows;
+  int firstPoint;
+  double firstX;
+  double lastX;
+  QVector<double> mins;
+  QVector<double> maxs;
+
+};
+
+
+
+// One chunk as described by the index.
+struct HistoryChunk {
+  qint64 offset;
+  qint64 bytes;
+  int rows;
+  int firstPoint;
+  double firstX;
+  double lastX;
+  QVector<double> mins;
+  QVector<double> maxs;
+};
+
+
+// Rows of a chunk read back from the data file; the values left out within
+// the deadband ("=") are filled with the value recorded last, those not
+// sampled ("-") with NaN.
+struct HistoryRows {
+  QVector<double> x;
+  QVector<double> values; // row by row, one value per signal
+};
+
+
+// Reads the history of a data file through its chunk index. The rows are
+// paged in a chunk at a time and kept in an LRU cache bounded in bytes, so
+// that any length of history can be browsed with a fixed memory ceiling.
+class History {
+
+public:
+
+  History();
+
+  // (re)reads the index, which grows while the scan records
+  bool open(const QString & dataFileName);
+  void close();
+  inline bool isOpen() const {return ! dataName.isEmpty();}
+
+  void setCacheSize(qint64 bytes);
+  inline const QStringList & signalNames() const {return names;}
+  inline int chunks() const {return index.size();}
+  inline const HistoryChunk & chunk(int idx) const {return index[idx];}
+  QList<int> chunksIn(double x0, double x1) const;
+
+  // 0 if the chunk cannot be read; valid until the next call
+  const HistoryRows * rows(int idx);
+
+private:
+
+  QString dataName;
+  qint64 indexSize; // already read
+  bool timestamped;
+  int stride;
+  QStringList names;
+  QVector<HistoryChunk> index;
+  QCache<int, HistoryRows> cache;
+
+  HistoryRows * read(const HistoryChunk & chk);
+
+};
+
+
+#endif // HISTORY_H
@@ -0,0 +1,147 @@
+#include <math.h>
+
+#include "kernels.h"
+
+#if defined(__GNUC__) && ( defined(__x86_64__) || defined(__i386__) )
+#define KERNELS_X86
+#include <immintrin.h>
+#endif
+
+
+
+static inline LineStats finishStats(double mn, double mx, long firstNaN) {
+  LineStats st;
+  const bool empty = mn > mx; // nothing but NaNs
+  st.min = empty ? NAN : mn;
+  st.max = empty ? NAN : mx;
+  st.firstNaN = firstNaN;
+  return st;
+}
+
+
+static LineStats statsScalar(const double * data, long size) {
+  double mn = INFINITY, mx = -INFINITY;
+  long firstNaN = -1;
+  for (long i = 0 ; i < size ; i++) {
+    const double v = data[i];
+    if ( isnan(v) ) {
+      if (firstNaN < 0)
+        firstNaN = i;
+    } else {
+      if (v < mn) mn = v;
+      if (v > mx) mx = v;
+    }
+  }
+  return finishStats(mn, mx, firstNaN);
+}
+
+
+
+
+#ifdef KERNELS_X86
+
+// min/max_pd return the second operand if either one is NaN: keeping the
+// accumulator second makes them skip NaNs for free.
+
+__attribute__((target("sse2")))
+static LineStats statsSse2(const double * data, long size) {
+  __m128d vmn = _mm_set1_pd(INFINITY), vmx = _mm_set1_pd(-INFINITY);
+  long firstNaN = -1;
+  long i = 0;
+  for ( ; i + 2 <= size ; i += 2) {
+    const __m128d v = _mm_loadu_pd(data + i);
+    vmn = _mm_min_pd(v, vmn);
+    vmx = _mm_max_pd(v, vmx);
+    if (firstNaN < 0) {
+      const int mask = _mm_movemask_pd(_mm_cmpunord_pd(v, v));
+      if (mask)
+        firstNaN = i + __builtin_ctz(mask);
+    }
+  }
+  double mn[2], mx[2];
+  _mm_storeu_pd(mn, vmn);
+  _mm_storeu_pd(mx, vmx);
+  LineStats tail = statsScalar(data + i, size - i);
+  if ( firstNaN < 0 && tail.firstNaN >= 0 )
+    firstNaN = i + tail.firstNaN;
+  double rmn = mn[0] < mn[1] ? mn[0] : mn[1];
+  double rmx = mx[0] > mx[1] ? mx[0] : mx[1];
+  if ( ! isnan(tail.min) ) {
+    if (tail.min < rmn) rmn = tail.min;
+    if (tail.max > rmx) rmx = tail.max;
+  }
+  return finishStats(rmn, rmx, firstNaN);
+}
+
+__attribute__((target("avx2")))
+static LineStats statsAvx2(const double * data, long size) {
+  __m256d vmn = _mm256_set1_pd(INFINITY), vmx = _mm256_set1_pd(-INFINITY);
+  long firstNaN = -1;
+  long i = 0;
+  for ( ; i + 4 <= size ; i += 4) {
+    const __m256d v = _mm256_loadu_pd(data + i);
+    vmn = _mm256_min_pd(v, vmn);
+    vmx = _mm256_max_pd(v, vmx);
+    if (firstNaN < 0) {
+      const int mask = _mm256_movemask_pd(_mm256_cmp_pd(v, v, _CMP_UNORD_Q));
+      if (mask)
+        firstNaN = i + __builtin_ctz(mask);
+    }
+  }
+  double mn[4], mx[4];
+  _mm256_storeu_pd(mn, vmn);
+  _mm256_storeu_pd(mx, vmx);
+  LineStats tail = statsScalar(data + i, size - i);
+  if ( firstNaN < 0 && tail.firstNaN >= 0 )
+    firstNaN = i + tail.firstNaN;
+  double rmn = tail.min, rmx = tail.max;
+  if ( isnan(rmn) ) {
+    rmn = INFINITY;
+    rmx = -INFINITY;
+  }
+  for (int k = 0 ; k < 4 ; k++) {
+    if (mn[k] < rmn) rmn = mn[k];
+    if (mx[k] > rmx) rmx = mx[k];
+  }
+  return finishStats(rmn, rmx, firstNaN);
+}
+
+#endif // KERNELS_X86
+
+
+
+struct KernelSet {
+  const char * isa;
+  LineStats (*stats)(const double *, long);
+};
+
+static KernelSet selectKernels() {
+  #ifdef KERNELS_X86
+  __builtin_cpu_init();
+  if ( __builtin_cpu_supports("avx2") ) {
+    KernelSet ks = {"avx2", statsAvx2};
+    return ks;
+  }
+  if ( __builtin_cpu_supports("sse2") ) {
+    KernelSet ks = {"sse2", statsSse2};
+    return ks;
+  }
+  #endif
+  KernelSet ks = {"scalar", statsScalar};
+  return ks;
+}
+
+static const KernelSet & kernels() {
+  static const KernelSet ks = selectKernels();
+  return ks;
+}
+
+
+
+LineStats lineStats(const double * data, long size) {
+  return kernels().stats(data, size);
+}
+
+const char * lineKernelsIsa() {
+  return kernels().isa;
+}
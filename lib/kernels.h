@@ -0,0 +1,22 @@
+#ifndef KERNELS_H
+#define KERNELS_H
+
+
+// Fused passes over the signal buffers. Each kernel has AVX2, SSE2 and
+// scalar implementations; the best one supported by the CPU is picked at
+// run time on the first call.
+
+struct LineStats {
+  double min;     // smallest non-NaN value, NaN if there is none
+  double max;     // largest non-NaN value, NaN if there is none
+  long firstNaN;  // index of the first NaN, -1 if there is none
+};
+
+// min, max and first NaN in a single pass.
+LineStats lineStats(const double * data, long size);
+
+// name of the instruction set in use: "avx2", "sse2" or "scalar".
+const char * lineKernelsIsa();
+
+
+#endif // KERNELS_H
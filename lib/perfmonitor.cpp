@@ -0,0 +1,173 @@
+#include <QtAlgorithms>
+#include <math.h>
+
+#include "perfmonitor.h"
+
+
+
+
+Histogram::Histogram() :
+  counts( subCount + (63-subBits) * halfCount, 0 )
+{
+  reset();
+}
+
+void Histogram::reset() {
+  counts.fill(0);
+  _count = 0;
+  _min = 0;
+  _max = 0;
+  _sum = 0.0;
+}
+
+int Histogram::index(qint64 value) {
+  if ( value < subCount )
+    return value;
+  const int msb = 63 - qCountLeadingZeroBits( (quint64) value );
+  const int shift = msb - subBits + 1;
+  const int top = value >> shift;
+  return subCount + (shift-1) * halfCount + (top - halfCount);
+}
+
+qint64 Histogram::lowerBound(int idx) {
+  if ( idx < subCount )
+    return idx;
+  const int shift = (idx - subCount) / halfCount + 1;
+  const qint64 top = (idx - subCount) % halfCount + halfCount;
+  return top << shift;
+}
+
+qint64 Histogram::upperBound(int idx) {
+  return idx < subCount  ?  idx  :  lowerBound(idx+1) - 1 ;
+}
+
+void Histogram::record(qint64 value) {
+  if (value < 0)
+    value = 0;
+  counts[index(value)]++;
+  if ( ! _count || value < _min )
+    _min = value;
+  if ( ! _count || value > _max )
+    _max = value;
+  _sum += value;
+  _count++;
+}
+
+qint64 Histogram::percentile(double pc) const {
+  if ( ! _count )
+    return 0;
+  const qint64 target = qMax<qint64>(1, (qint64) ceil( _count * pc / 100.0 ) );
+  qint64 cumulative = 0;
+  for ( int idx = 0 ; idx < counts.size() ; idx++ ) {
+    cumulative += counts[idx];
+    if ( cumulative >= target )
+      return qMin( upperBound(idx), _max );
+  }
+  return _max;
+}
+
+
+
+
+
+
+PerfMonitor::PerfMonitor() :
+  intervalNs(0),
+  _ticks(0),
+  lastTickAt(0)
+{
+  scanClock.start();
+  tickClock.start();
+  lapClock.start();
+}
+
+const char * PerfMonitor::phaseName(Phase phase) {
+  switch (phase) {
+    case PvRead: return "PV read";
+    case Table:  return "Table";
+    case File:   return "File";
+    case Stats:  return "Stats";
+    case Publish: return "Publish";
+    case Trigger: return "Trigger";
+    case Script: return "Script";
+    case Ranges: return "Ranges";
+    case Replot: return "Replot";
+    case Analysis: return "Analysis";
+    case Tick:   return "Tick";
+    default:     return "";
+  }
+}
+
+void PerfMonitor::reset(double interval) {
+  for (int ph = 0 ; ph < Phases ; ph++)
+    hist[ph].reset();
+  queues.clear();
+  intervalNs = (qint64) (interval * 1.0e9);
+  _ticks = 0;
+  lastTickAt = 0;
+  scanClock.start();
+}
+
+void PerfMonitor::beginTick() {
+  _ticks++;
+  lastTickAt = scanClock.nsecsElapsed();
+  tickClock.start();
+  lapClock.start();
+}
+
+void PerfMonitor::lap(Phase phase) {
+  hist[phase].record(lapClock.nsecsElapsed());
+  lapClock.start();
+}
+
+void PerfMonitor::endTick() {
+  hist[Tick].record(tickClock.nsecsElapsed());
+}
+
+void PerfMonitor::setQueueDepth(const QString & queue, qint64 depth) {
+  queues[queue] = depth;
+}
+
+qint64 PerfMonitor::missedTicks() const {
+  if ( intervalNs <= 0 || ! _ticks )
+    return 0;
+  const qint64 expected = lastTickAt / intervalNs + 1;
+  return qMax<qint64>(0, expected - _ticks);
+}
+
+double PerfMonitor::sampleRate() const {
+  return ( _ticks > 1 && lastTickAt > 0 )  ?
+        1.0e9 * (_ticks-1) / lastTickAt  :  0.0 ;
+}
+
+QString PerfMonitor::report(const QString & prefix) const {
+
+  QString rep;
+  rep += prefix + QString("Ticks: %1, rate: %2 Hz, missed: %3\n")
+      .arg(_ticks).arg(sampleRate(), 0, 'f', 3).arg(missedTicks());
+
+  rep += prefix + QString("%1 %2 %3 %4 %5  (ms)\n")
+      .arg("Phase", -8).arg("mean", 9).arg("p50", 9).arg("p99", 9).arg("max", 9);
+  for (int ph = 0 ; ph < Phases ; ph++) {
+    const Histogram & hst = hist[ph];
+    if ( ! hst.count() )
+      continue;
+    rep += prefix + QString("%1 %2 %3 %4 %5\n")
+        .arg(phaseName( (Phase) ph ), -8)
+        .arg(hst.mean() / 1.0e6, 9, 'f', 3)
+        .arg(hst.percentile(50) / 1.0e6, 9, 'f', 3)
+        .arg(hst.percentile(99) / 1.0e6, 9, 'f', 3)
+        .arg(hst.max() / 1.0e6, 9, 'f', 3);
+  }
+
+  if ( ! queues.isEmpty() ) {
+    rep += prefix + "Queues:";
+    QMap<QString, qint64>::const_iterator it;
+    for ( it = queues.constBegin() ; it != queues.constEnd() ; ++it )
+      rep += " " + it.key() + "=" + QString::number(it.value());
+    rep += "\n";
+  }
+
+  return rep;
+
+}
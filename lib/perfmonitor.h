@@ -0,0 +1,98 @@
+#ifndef PERFMONITOR_H
+#define PERFMONITOR_H
+
+#include <QElapsedTimer>
+#include <QString>
+#include <QVector>
+#include <QMap>
+
+
+// Log-linear (HDR-style) histogram of non-negative integer values.
+// Values below 2^subBits are counted exactly; above that every power of two
+// is split into 2^(subBits-1) buckets, giving ~3% relative precision over the
+// whole qint64 range with a fixed footprint and O(1) recording.
+class Histogram {
+
+private:
+
+  static const int subBits = 6;
+  static const int subCount = 1 << subBits;
+  static const int halfCount = subCount / 2;
+  QVector<qint64> counts;
+  qint64 _count;
+  qint64 _min;
+  qint64 _max;
+  double _sum;
+
+  static int index(qint64 value);
+  static qint64 lowerBound(int idx);
+  static qint64 upperBound(int idx);
+
+public:
+
+  Histogram();
+
+  void reset();
+  void record(qint64 value);
+
+  inline qint64 count() const {return _count;}
+  inline qint64 min() const {return _min;}
+  inline qint64 max() const {return _max;}
+  inline double mean() const {return _count ? _sum/_count : 0.0 ;}
+  qint64 percentile(double pc) const;
+
+};
+
+
+
+// Timing of the acquisition tick. Each phase of the tick is closed with lap()
+// which records the time since the previous lap into the phase's histogram.
+class PerfMonitor {
+
+public:
+
+  enum Phase {
+    PvRead,
+    Table,
+    File,
+    Stats,
+    Publish,
+    Trigger,
+    Script,
+    Ranges,
+    Replot,
+    Analysis,
+    Tick,
+    Phases // number of phases, not a phase itself
+  };
+
+  PerfMonitor();
+
+  void reset(double interval);
+  void beginTick();
+  void lap(Phase phase);
+  void endTick();
+  void setQueueDepth(const QString & queue, qint64 depth);
+
+  inline qint64 ticks() const {return _ticks;}
+  qint64 missedTicks() const;
+  double sampleRate() const;
+  QString report(const QString & prefix=QString()) const;
+
+private:
+
+  static const char * phaseName(Phase phase);
+
+  Histogram hist[Phases];
+  QMap<QString, qint64> queues;
+  QElapsedTimer scanClock;
+  QElapsedTimer tickClock;
+  QElapsedTimer lapClock;
+  qint64 intervalNs;
+  qint64 _ticks;
+  qint64 lastTickAt;
+
+};
+
+
+#endif // PERFMONITOR_H
@@ -0,0 +1,243 @@
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QLocalServer>
+#include <QLocalSocket>
+#include <QDataStream>
+#include <QRegExp>
+#include <QDebug>
+
+#include "publisher.h"
+
+
+
+static QByteArray frame(char type, const QByteArray & payload=QByteArray()) {
+  QByteArray out;
+  QDataStream ds(&out, QIODevice::WriteOnly);
+  ds.setByteOrder(QDataStream::LittleEndian);
+  ds << (quint32) (payload.size() + 1) << (qint8) type;
+  out.append(payload);
+  return out;
+}
+
+
+QByteArray Publisher::rowFrame(qint64 msec, const QVector<double> & values) {
+  QByteArray payload;
+  payload.reserve(10 + values.size() * 10);
+  QDataStream ds(&payload, QIODevice::WriteOnly);
+  ds.setByteOrder(QDataStream::LittleEndian);
+  ds.setFloatingPointPrecision(QDataStream::DoublePrecision);
+  ds << msec << (quint16) values.size();
+  for (int id = 0 ; id < values.size() ; id++)
+    ds << (quint16) id << values[id];
+  return frame('R', payload);
+}
+
+
+
+Publisher::Publisher(QObject * parent) :
+  QObject(parent),
+  tcp(0),
+  local(0),
+  lastId(0),
+  queueLimit(1024),
+  defaultPolicy(DropOldest),
+  _dropped(0)
+{}
+
+Publisher::~Publisher() {
+  close();
+}
+
+
+bool Publisher::listen(const QString & address) {
+
+  close();
+  if ( address.isEmpty() )
+    return false;
+  _address = address;
+
+  QRegExp tcpAddress("(?:(.+):)?(\\d+)");
+  if ( tcpAddress.exactMatch(address) ) {
+    const QHostAddress host = tcpAddress.cap(1).isEmpty()  ?
+          QHostAddress(QHostAddress::Any)  :  QHostAddress(tcpAddress.cap(1)) ;
+    tcp = new QTcpServer(this);
+    connect(tcp, SIGNAL(newConnection()), SLOT(accept()));
+    if ( ! tcp->listen(host, tcpAddress.cap(2).toUShort()) ) {
+      qDebug() << "Can't publish on" << address << ":" << tcp->errorString();
+      close();
+      return false;
+    }
+  } else {
+    local = new QLocalServer(this);
+    connect(local, SIGNAL(newConnection()), SLOT(accept()));
+    QLocalServer::removeServer(address); // left by a crashed instance
+    if ( ! local->listen(address) ) {
+      qDebug() << "Can't publish on" << address << ":" << local->errorString();
+      close();
+      return false;
+    }
+  }
+  return true;
+
+}
+
+
+void Publisher::close() {
+  foreach (int client, queues.keys())
+    drop(client);
+  delete tcp;
+  tcp = 0;
+  delete local;
+  local = 0;
+  _address.clear();
+}
+
+
+bool Publisher::isListening() const {
+  return ( tcp && tcp->isListening() ) || ( local && local->isListening() );
+}
+
+
+int Publisher::queued() const {
+  int count = 0;
+  foreach (const Queue & q, queues)
+    count += q.frames.size();
+  return count;
+}
+
+
+void Publisher::accept() {
+  while ( tcp && tcp->hasPendingConnections() )
+    addClient(tcp->nextPendingConnection());
+  while ( local && local->hasPendingConnections() )
+    addClient(local->nextPendingConnection());
+}
+
+
+void Publisher::addClient(QIODevice * dev) {
+  const int client = ++lastId;
+  Queue q;
+  q.dev = dev;
+  q.policy = defaultPolicy;
+  queues.insert(client, q);
+  connect(dev, SIGNAL(readyRead()), SLOT(readCommands()));
+  connect(dev, SIGNAL(bytesWritten(qint64)), SLOT(writeQueued()));
+  connect(dev, SIGNAL(disconnected()), SLOT(disconnected()));
+  if ( ! signalsFrame.isEmpty() )
+    enqueue(client, signalsFrame, false);
+}
+
+
+int Publisher::clientOf(QObject * dev) const {
+  for (QHash<int, Queue>::const_iterator it = queues.constBegin() ; it != queues.constEnd() ; ++it)
+    if ( it->dev == dev )
+      return it.key();
+  return 0;
+}
+
+
+void Publisher::drop(int client) {
+  if ( ! queues.contains(client) )
+    return;
+  QIODevice * dev = queues.take(client).dev;
+  dev->disconnect(this);
+  dev->close();
+  dev->deleteLater();
+}
+
+
+void Publisher::readCommands() {
+  const int client = clientOf(sender());
+  if ( ! client )
+    return;
+  const QByteArray commands = queues[client].dev->readAll();
+  foreach (char command, commands) {
+    switch (command) {
+      case 'P': emit replayRequested(client); break;
+      case 'O': queues[client].policy = DropOldest; break;
+      case 'N': queues[client].policy = DropNewest; break;
+      case 'D': queues[client].policy = Disconnect; break;
+    }
+    if ( ! queues.contains(client) ) // dropped while replaying
+      return;
+  }
+}
+
+
+void Publisher::writeQueued() {
+  flush(clientOf(sender()));
+}
+
+
+void Publisher::disconnected() {
+  drop(clientOf(sender()));
+}
+
+
+void Publisher::flush(int client) {
+  if ( ! queues.contains(client) )
+    return;
+  Queue & q = queues[client];
+  while ( ! q.frames.isEmpty()  &&  q.dev->bytesToWrite() < writeWindow )
+    q.dev->write(q.frames.takeFirst());
+}
+
+
+void Publisher::enqueue(int client, const QByteArray & frm, bool limited) {
+  if ( ! queues.contains(client) )
+    return;
+  Queue & q = queues[client];
+  if ( limited  &&  q.frames.size() >= queueLimit ) {
+    _dropped++;
+    switch (q.policy) {
+      case DropOldest:
+        q.frames.removeFirst();
+        break;
+      case DropNewest:
+        return;
+      case Disconnect:
+        drop(client);
+        return;
+    }
+  }
+  q.frames.append(frm);
+  flush(client);
+}
+
+
+void Publisher::setSignals(const QStringList & _pvs) {
+  if ( _pvs == pvs && ! signalsFrame.isEmpty() )
+    return;
+  pvs = _pvs;
+  QByteArray payload;
+  QDataStream ds(&payload, QIODevice::WriteOnly);
+  ds.setByteOrder(QDataStream::LittleEndian);
+  ds << (quint16) pvs.size();
+  for (int id = 0 ; id < pvs.size() ; id++) {
+    const QByteArray name = pvs[id].toUtf8();
+    ds << (quint16) id << (quint16) name.size();
+    ds.writeRawData(name.constData(), name.size());
+  }
+  signalsFrame = frame('H', payload);
+  foreach (int client, queues.keys())
+    enqueue(client, signalsFrame, false);
+}
+
+
+void Publisher::publish(qint64 msec, const QVector<double> & values) {
+  if ( queues.isEmpty() )
+    return;
+  const QByteArray frm = rowFrame(msec, values);
+  foreach (int client, queues.keys())
+    enqueue(client, frm);
+}
+
+
+void Publisher::replayRow(int client, qint64 msec, const QVector<double> & values) {
+  enqueue(client, rowFrame(msec, values), false);
+}
+
+
+void Publisher::endReplay(int client) {
+  enqueue(client, frame('E'), false);
+}
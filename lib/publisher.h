@@ -0,0 +1,108 @@
+#ifndef PUBLISHER_H
+#define PUBLISHER_H
+
+#include <QObject>
+#include <QStringList>
+#include <QVector>
+#include <QList>
+#include <QHash>
+#include <QByteArray>
+
+class QIODevice;
+class QTcpServer;
+class QLocalServer;
+
+
+// Broadcasts the acquired rows to any number of subscribers over TCP
+// (address "port" or "host:port") or a local socket (any other address).
+//
+// Every frame is a little-endian uint32 length of what follows, a type byte
+// and the payload:
+//  'H' signals: uint16 count, then per signal uint16 id, uint16 length and
+//      the UTF-8 PV name. Sent on connect and whenever the signals change.
+//  'R' row: int64 time (ms since epoch), uint16 count, then per value
+//      uint16 id and float64.
+//  'E' end of the replay.
+// A subscriber may send single command bytes:
+//  'P' replay the rows of the window, ended with 'E';
+//  'O', 'N', 'D' set its policy for a full queue: drop the oldest frame,
+//      drop the newest one, or disconnect.
+// Frames are queued per client and passed to the socket only while the
+// socket holds less than writeWindow bytes, so a slow client never makes
+// the socket buffers grow; once the queue holds queueLimit frames the
+// client's policy applies. Replays are not subject to the limit.
+class Publisher : public QObject {
+  Q_OBJECT;
+
+public:
+
+  enum Policy {
+    DropOldest,
+    DropNewest,
+    Disconnect
+  };
+
+  Publisher(QObject * parent=0);
+  ~Publisher();
+
+  bool listen(const QString & address);
+  void close();
+  inline const QString & address() const {return _address;}
+  bool isListening() const;
+  inline int clients() const {return queues.size();}
+  int queued() const; // frames waiting in all queues
+  inline qint64 dropped() const {return _dropped;}
+
+  inline void setQueueLimit(int lim) {queueLimit = lim;}
+  inline void setDefaultPolicy(Policy pol) {defaultPolicy = pol;}
+
+  void setSignals(const QStringList & pvs);
+  void publish(qint64 msec, const QVector<double> & values);
+
+  // the answer to replayRequested()
+  void replayRow(int client, qint64 msec, const QVector<double> & values);
+  void endReplay(int client);
+
+signals:
+
+  void replayRequested(int client);
+
+private slots:
+
+  void accept();
+  void readCommands();
+  void writeQueued();
+  void disconnected();
+
+private:
+
+  static const qint64 writeWindow = 256 * 1024;
+
+  struct Queue {
+    QIODevice * dev;
+    QList<QByteArray> frames;
+    Policy policy;
+  };
+
+  QString _address;
+  QTcpServer * tcp;
+  QLocalServer * local;
+  QStringList pvs;
+  QByteArray signalsFrame;
+  QHash<int, Queue> queues;
+  int lastId;
+  int queueLimit;
+  Policy defaultPolicy;
+  qint64 _dropped;
+
+  void addClient(QIODevice * dev);
+  int clientOf(QObject * dev) const;
+  void enqueue(int client, const QByteArray & frame, bool limited=true);
+  void flush(int client);
+  void drop(int client);
+  static QByteArray rowFrame(qint64 msec, const QVector<double> & values);
+
+};
+
+
+#endif // PUBLISHER_H
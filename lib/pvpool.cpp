@@ -0,0 +1,208 @@
+#include <QDebug>
+
+#include "pvpool.h"
+
+
+
+QHash<QString, PvPool::Entry> & PvPool::pool() {
+  static QHash<QString, Entry> entries;
+  return entries;
+}
+
+
+QHash<QString, PvPool::Entry>::iterator PvPool::find(QEpicsPv * pv) {
+  QHash<QString, Entry>::iterator it = pool().begin();
+  while ( it != pool().end() && it->pv != pv )
+    ++it;
+  return it;
+}
+
+
+QEpicsPv * PvPool::acquire(const QString & pvName) {
+  QHash<QString, Entry>::iterator it = pool().find(pvName);
+  if ( it == pool().end() ) {
+    Entry entry;
+    entry.pv = new QEpicsPv;
+    entry.refs = 0;
+    entry.opened.start();
+    entry.connectTime = -1;
+    if ( ! pvName.isEmpty() )
+      QObject::connect(entry.pv, SIGNAL(connectionChanged(bool)),
+                       PvWatch::instance(), SLOT(noteConnection(bool)));
+    it = pool().insert(pvName, entry);
+    it->pv->setPV(pvName);
+  }
+  it->refs++;
+  return it->pv;
+}
+
+
+void PvPool::release(QEpicsPv * pv) {
+  if ( ! pv )
+    return;
+  QHash<QString, Entry>::iterator it = find(pv);
+  if ( it == pool().end() )
+    return;
+  if ( --it->refs <= 0 ) {
+    delete it->pv;
+    pool().erase(it);
+  }
+}
+
+
+int PvPool::users(const QString & pvName) {
+  return pool().contains(pvName)  ?  pool().value(pvName).refs  :  0 ;
+}
+
+
+QString PvPool::name(QEpicsPv * pv) {
+  QHash<QString, Entry>::iterator it = find(pv);
+  return it == pool().end()  ?  QString()  :  it.key() ;
+}
+
+
+qint64 PvPool::connectTime(QEpicsPv * pv) {
+  QHash<QString, Entry>::iterator it = find(pv);
+  return it == pool().end()  ?  -1  :  it->connectTime ;
+}
+
+
+void PvPool::noteConnection(QEpicsPv * pv) {
+  QHash<QString, Entry>::iterator it = find(pv);
+  if ( it != pool().end() && it->connectTime < 0 && pv->isConnected() )
+    it->connectTime = it->opened.elapsed();
+}
+
+
+
+#ifdef TIMESCAN_GROUPREAD
+
+QHash<QString, PvPool::Channel> & PvPool::channels() {
+  static QHash<QString, Channel> entries;
+  return entries;
+}
+
+
+chid PvPool::acquireChannel(const QString & pvName) {
+  if ( pvName.isEmpty() )
+    return 0;
+  QHash<QString, Channel>::iterator it = channels().find(pvName);
+  if ( it == channels().end() ) {
+    if ( ! ca_current_context() )
+      ca_context_create(ca_enable_preemptive_callback);
+    Channel entry;
+    entry.channel = 0;
+    entry.refs = 0;
+    const int status = ca_create_channel( pvName.toLatin1().constData(),
+                                          0, 0, CA_PRIORITY_DEFAULT, &entry.channel );
+    if ( status != ECA_NORMAL ) {
+      qDebug() << "ERROR! Can't create channel" << pvName << ":" << ca_message(status);
+      return 0;
+    }
+    ca_flush_io(); // the search goes out now, the connection follows in the background
+    it = channels().insert(pvName, entry);
+  }
+  it->refs++;
+  return it->channel;
+}
+
+
+void PvPool::releaseChannel(chid channel) {
+  if ( ! channel )
+    return;
+  QHash<QString, Channel>::iterator it = channels().begin();
+  while ( it != channels().end() && it->channel != channel )
+    ++it;
+  if ( it == channels().end() )
+    return;
+  if ( --it->refs <= 0 ) {
+    ca_clear_channel(it->channel);
+    channels().erase(it);
+  }
+}
+
+#endif
+
+
+
+
+PvWatch * PvWatch::instance() {
+  static PvWatch watch;
+  return &watch;
+}
+
+
+void PvWatch::noteConnection(bool con) {
+  if (con)
+    PvPool::noteConnection(qobject_cast<QEpicsPv*>(sender()));
+}
+
+
+
+
+ConnectBarrier::ConnectBarrier(QObject * parent) :
+  QObject(parent)
+{
+  timer.setSingleShot(true);
+  connect(&timer, SIGNAL(timeout()), SLOT(expire()));
+}
+
+
+bool ConnectBarrier::wait(const QList<QEpicsPv*> & pvs, int timeout) {
+  cancel();
+  missed.clear();
+  foreach (QEpicsPv * pv, pvs)
+    if ( pv && ! pv->isConnected() ) {
+      pending << pv;
+      connect(pv, SIGNAL(connectionChanged(bool)), SLOT(check()));
+    }
+  if ( pending.isEmpty() )
+    return false;
+  timer.start(timeout);
+  return true;
+}
+
+
+void ConnectBarrier::cancel() {
+  timer.stop();
+  foreach (QEpicsPv * pv, pending)
+    if (pv)
+      disconnect(pv, 0, this, 0);
+  pending.clear();
+}
+
+
+QStringList ConnectBarrier::missing() const {
+  if ( ! isWaiting() )
+    return missed;
+  QStringList names;
+  foreach (QEpicsPv * pv, pending)
+    if ( pv && ! pv->isConnected() )
+      names << PvPool::name(pv);
+  return names;
+}
+
+
+void ConnectBarrier::check() {
+  foreach (QEpicsPv * pv, pending)
+    if ( pv && ! pv->isConnected() )
+      return;
+  finish();
+}
+
+
+void ConnectBarrier::expire() {
+  finish();
+}
+
+
+void ConnectBarrier::finish() {
+  missed.clear();
+  foreach (QEpicsPv * pv, pending)
+    if ( pv && ! pv->isConnected() )
+      missed << PvPool::name(pv);
+  cancel();
+  if ( ! missed.isEmpty() )
+    qDebug() << "Not connected after the timeout:" << missed;
+  emit done(missed.isEmpty());
+}
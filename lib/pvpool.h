@@ -0,0 +1,118 @@
+#ifndef PVPOOL_H
+#define PVPOOL_H
+
+#include <QObject>
+#include <QHash>
+#include <QString>
+#include <QStringList>
+#include <QElapsedTimer>
+#include <QPointer>
+#include <QTimer>
+
+#include <qtpv.h>
+
+#ifdef TIMESCAN_GROUPREAD
+#include <cadef.h>
+#endif
+
+
+// Process-wide, reference-counted pool of QEpicsPv objects. Every chart
+// monitoring the same PV gets the same object and therefore shares one
+// channel and one stream of monitor updates. The PV object is owned by the
+// pool and is deleted when the last user releases it.
+// The channel is opened when the PV is first acquired, so all the PVs of
+// the signals being set up connect in parallel; the pool notes how long
+// each one took.
+// The grouped gets (GroupRead) need plain Channel Access channels, which
+// QEpicsPv does not expose: the pool keeps one of those per PV as well,
+// shared by all the charts reading the PV in the snapshot mode.
+class PvPool {
+
+public:
+
+  static QEpicsPv * acquire(const QString & pvName);
+  static void release(QEpicsPv * pv);
+  static int users(const QString & pvName);
+  static QString name(QEpicsPv * pv);
+  static qint64 connectTime(QEpicsPv * pv); // ms from opening, -1 if not connected yet
+  static void noteConnection(QEpicsPv * pv); // from PvWatch
+
+  #ifdef TIMESCAN_GROUPREAD
+  // created without waiting for the connection; 0 on failure
+  static chid acquireChannel(const QString & pvName);
+  static void releaseChannel(chid channel);
+  #endif
+
+private:
+
+  struct Entry {
+    QEpicsPv * pv;
+    int refs;
+    QElapsedTimer opened;
+    qint64 connectTime;
+  };
+  static QHash<QString, Entry> & pool();
+  static QHash<QString, Entry>::iterator find(QEpicsPv * pv);
+
+  #ifdef TIMESCAN_GROUPREAD
+  struct Channel {
+    chid channel;
+    int refs;
+  };
+  static QHash<QString, Channel> & channels();
+  #endif
+
+};
+
+
+// Notes the first connection of every PV of the pool; for PvPool only.
+class PvWatch : public QObject {
+  Q_OBJECT;
+
+public:
+
+  static PvWatch * instance();
+
+private slots:
+
+  void noteConnection(bool con);
+
+};
+
+
+// Readiness barrier: waits until all the given PVs are connected, or the
+// timeout expires, without blocking the event loop. done() tells which of
+// the two happened.
+class ConnectBarrier : public QObject {
+  Q_OBJECT;
+
+public:
+
+  ConnectBarrier(QObject * parent=0);
+
+  // false if all the PVs are connected already: done() is not emitted then
+  bool wait(const QList<QEpicsPv*> & pvs, int timeout);
+  void cancel();
+  inline bool isWaiting() const {return timer.isActive();}
+  QStringList missing() const; // not connected yet, or when the wait ended
+
+signals:
+
+  void done(bool allConnected);
+
+private slots:
+
+  void check();
+  void expire();
+
+private:
+
+  QList< QPointer<QEpicsPv> > pending;
+  QStringList missed;
+  QTimer timer;
+  void finish();
+
+};
+
+
+#endif // PVPOOL_H
@@ -0,0 +1,151 @@
+#include <QPainter>
+#include <QImage>
+#include <QImageWriter>
+#include <QSvgGenerator>
+#include <QPdfWriter>
+#include <QPageSize>
+#include <QFileInfo>
+#include <QThreadPool>
+#include <QRunnable>
+#include <QVector>
+
+#include <qwt_plot.h>
+#include <qwt_plot_renderer.h>
+
+#include "renderer.h"
+
+
+static const int screenDpi = 96; // of the recorded coordinates in the pdf
+
+
+static QString suffix(const QString & fileName) {
+  return QFileInfo(fileName).suffix().toLower();
+}
+
+
+bool SnapshotRenderer::isSupported(const QString & fileName) {
+  const QString sfx = suffix(fileName);
+  return sfx == "svg" || sfx == "pdf" ||
+         QImageWriter::supportedImageFormats().contains(sfx.toLatin1());
+}
+
+QString SnapshotRenderer::formats() {
+  return "png, svg or pdf";
+}
+
+
+PlotSnapshot SnapshotRenderer::snapshot(QwtPlot * plot, const QString & fileName,
+                                        const QSize & size) {
+  PlotSnapshot snap;
+  snap.fileName = fileName;
+  snap.size = size.isValid()  ?  size  :  plot->size() ;
+  QPainter painter(&snap.picture);
+  QwtPlotRenderer renderer;
+  renderer.render(plot, &painter, QRectF(QPointF(0, 0), snap.size));
+  painter.end();
+  return snap;
+}
+
+
+// Replays the picture into the file; returns the error, empty on success.
+static QString renderSnapshot(const PlotSnapshot & snap) {
+
+  const QString sfx = suffix(snap.fileName);
+  QPainter painter;
+
+  if ( sfx == "svg" ) {
+    QSvgGenerator svg;
+    svg.setFileName(snap.fileName);
+    svg.setSize(snap.size);
+    svg.setViewBox(QRect(QPoint(0, 0), snap.size));
+    svg.setTitle(QFileInfo(snap.fileName).completeBaseName());
+    if ( ! painter.begin(&svg) )
+      return "Could not write " + snap.fileName;
+    painter.drawPicture(0, 0, snap.picture);
+    painter.end();
+    return QString();
+  }
+
+  if ( sfx == "pdf" ) {
+    QPdfWriter pdf(snap.fileName);
+    pdf.setResolution(screenDpi);
+    pdf.setPageSize(QPageSize(QSizeF(snap.size) * 25.4 / screenDpi, QPageSize::Millimeter));
+    pdf.setPageMargins(QMarginsF(0, 0, 0, 0));
+    pdf.setTitle(QFileInfo(snap.fileName).completeBaseName());
+    if ( ! painter.begin(&pdf) )
+      return "Could not write " + snap.fileName;
+    painter.drawPicture(0, 0, snap.picture);
+    painter.end();
+    return QString();
+  }
+
+  QImage image(snap.size, QImage::Format_ARGB32_Premultiplied);
+  image.fill(Qt::white);
+  painter.begin(&image);
+  painter.drawPicture(0, 0, snap.picture);
+  painter.end();
+  QImageWriter writer(snap.fileName, sfx.toLatin1());
+  if ( ! writer.write(image) )
+    return snap.fileName + ": " + writer.errorString();
+  return QString();
+
+}
+
+
+// One snapshot of the batch on the pool; every job has its own slot for
+// the result, so that no locking is needed.
+class SnapshotJob : public QRunnable {
+public:
+  SnapshotJob(const PlotSnapshot & _snap, QString * _error) :
+    snap(_snap), error(_error) {}
+  virtual void run() {
+    *error = renderSnapshot(snap);
+  }
+private:
+  PlotSnapshot snap;
+  QString * error;
+};
+
+
+
+
+SnapshotRenderer::SnapshotRenderer(QObject * parent) :
+  QThread(parent)
+{}
+
+
+SnapshotRenderer::~SnapshotRenderer() {
+  wait();
+}
+
+
+bool SnapshotRenderer::render(const QList<PlotSnapshot> & _batch) {
+  if ( isRunning() )
+    return false;
+  batch = _batch;
+  start(QThread::LowPriority);
+  return true;
+}
+
+
+void SnapshotRenderer::run() {
+
+  _written.clear();
+  _errors.clear();
+
+  QVector<QString> results(batch.size());
+  QThreadPool pool;
+  for (int idx = 0 ; idx < batch.size() ; idx++)
+    pool.start(new SnapshotJob(batch[idx], &results[idx]));
+  pool.waitForDone();
+
+  for (int idx = 0 ; idx < batch.size() ; idx++)
+    if ( results[idx].isEmpty() )
+      _written << batch[idx].fileName;
+    else
+      _errors << results[idx];
+
+  // release the pictures
+  batch.clear();
+
+}
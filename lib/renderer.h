@@ -0,0 +1,66 @@
+#ifndef RENDERER_H
+#define RENDERER_H
+
+#include <QThread>
+#include <QPicture>
+#include <QStringList>
+#include <QList>
+
+class QwtPlot;
+
+
+// A plot recorded for rendering: the paint commands of QwtPlotRenderer at
+// the final size, captured on the GUI thread. The picture is implicitly
+// shared and does not refer to the plot any more, so it can be replayed
+// anywhere while the plot goes on changing.
+struct PlotSnapshot {
+  QString fileName;
+  QSize size;
+  QPicture picture;
+};
+
+
+// Renders plot snapshots to files on its own thread, the snapshots of one
+// batch in parallel on a thread pool. Recording a snapshot costs about one
+// replot of the plot on the GUI thread; the rasterization, the vector output
+// and the image compression all happen here. Formats, chosen by the file
+// suffix:
+//  .svg - scalable vector graphics;
+//  .pdf - one page of the size of the snapshot;
+//  anything else - image written by QImage (png, jpg, bmp, ...).
+class SnapshotRenderer : public QThread {
+  Q_OBJECT;
+
+public:
+
+  static bool isSupported(const QString & fileName);
+  static QString formats(); // for the tool tips and the help
+
+  // records the plot at the given size, its own size if invalid
+  static PlotSnapshot snapshot(QwtPlot * plot, const QString & fileName,
+                               const QSize & size=QSize());
+
+  SnapshotRenderer(QObject * parent=0);
+  ~SnapshotRenderer();
+
+  // false if a batch is still being rendered
+  bool render(const QList<PlotSnapshot> & batch);
+
+  // valid once finished() is emitted and until the next render()
+  inline const QStringList & written() const {return _written;}
+  inline const QStringList & errors() const {return _errors;} // empty on success
+
+protected:
+
+  virtual void run();
+
+private:
+
+  QList<PlotSnapshot> batch;
+  QStringList _written;
+  QStringList _errors;
+
+};
+
+
+#endif // RENDERER_H
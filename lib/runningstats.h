@@ -0,0 +1,52 @@
+#ifndef RUNNINGSTATS_H
+#define RUNNINGSTATS_H
+
+#include <math.h>
+
+
+// Streaming mean / variance (Welford) with min, max and count.
+// NaNs are ignored.
+class RunningStats {
+
+private:
+
+  long n;
+  double _mean;
+  double m2;
+  double _min;
+  double _max;
+
+public:
+
+  RunningStats() {reset();}
+
+  inline void reset() {
+    n = 0;
+    _mean = m2 = 0.0;
+    _min = _max = NAN;
+  }
+
+  inline void add(double x) {
+    if ( isnan(x) )
+      return;
+    n++;
+    const double delta = x - _mean;
+    _mean += delta / n;
+    m2 += delta * (x - _mean);
+    if ( n == 1 || x < _min )
+      _min = x;
+    if ( n == 1 || x > _max )
+      _max = x;
+  }
+
+  inline long count() const {return n;}
+  inline double mean() const {return n ? _mean : NAN ;}
+  inline double variance() const {return n > 1 ? m2 / (n-1) : 0.0 ;}
+  inline double std() const {return sqrt(variance());}
+  inline double min() const {return _min;}
+  inline double max() const {return _max;}
+
+};
+
+
+#endif // RUNNINGSTATS_H
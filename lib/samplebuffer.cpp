@@ -0,0 +1,340 @@
+#include <math.h>
+#include <limits>
+
+#include "samplebuffer.h"
+
+
+
+int SampleBuffer::bytes(Precision prec) {
+  switch (prec) {
+    case Float64: return sizeof(double);
+    case Float32: return sizeof(float);
+    case Int32:   return sizeof(qint32);
+    case Int16:   return sizeof(qint16);
+  }
+  return sizeof(double);
+}
+
+QString SampleBuffer::name(Precision prec) {
+  switch (prec) {
+    case Float64: return "float64";
+    case Float32: return "float32";
+    case Int32:   return "int32";
+    case Int16:   return "int16";
+  }
+  return QString();
+}
+
+SampleBuffer::Precision SampleBuffer::fromName(const QString & nm, bool * ok) {
+  const Precision all[] = {Float64, Float32, Int32, Int16};
+  for (int idx = 0 ; idx < 4 ; idx++)
+    if ( nm == name(all[idx]) ) {
+      if (ok) *ok = true;
+      return all[idx];
+    }
+  if (ok) *ok = false;
+  return Float64;
+}
+
+
+SampleBuffer::SampleBuffer(Precision _prec) :
+  prec(_prec),
+  points(0),
+  head(0),
+  offset(0.0),
+  step(0.0)
+{}
+
+
+qint64 SampleBuffer::maxCode() const {
+  return prec == Int16  ?
+        std::numeric_limits<qint16>::max()  :  std::numeric_limits<qint32>::max() ;
+}
+
+
+void SampleBuffer::resize(int _points) {
+  points = _points;
+  f64.clear();
+  f32.clear();
+  i32.clear();
+  i16.clear();
+  switch (prec) {
+    case Float64: f64.resize(points); break;
+    case Float32: f32.resize(points); break;
+    case Int32:   i32.resize(points); break;
+    case Int16:   i16.resize(points); break;
+  }
+  clear();
+}
+
+
+void SampleBuffer::clear() {
+  head = points ? points-1 : 0 ;
+  offset = step = 0.0;
+  f64.fill(NAN);
+  f32.fill(NAN);
+  i32.fill(std::numeric_limits<qint32>::min());
+  i16.fill(std::numeric_limits<qint16>::min());
+}
+
+
+double SampleBuffer::decode(int idx) const {
+  switch (prec) {
+    case Float64:
+      return f64[idx];
+    case Float32:
+      return f32[idx];
+    case Int32:
+      return i32[idx] == std::numeric_limits<qint32>::min()  ?
+            NAN  :  offset + step * i32[idx] ;
+    case Int16:
+      return i16[idx] == std::numeric_limits<qint16>::min()  ?
+            NAN  :  offset + step * i16[idx] ;
+  }
+  return NAN;
+}
+
+
+bool SampleBuffer::encode(int idx, double value) {
+
+  if (prec == Float64) {
+    f64[idx] = value;
+    return true;
+  } else if (prec == Float32) {
+    f32[idx] = value;
+    return true;
+  }
+
+  qint64 code;
+  if ( ! isfinite(value) ) { // +-inf would break the offset and the step
+    code = prec == Int16  ?
+          std::numeric_limits<qint16>::min()  :  std::numeric_limits<qint32>::min() ;
+  } else {
+    if ( step == 0.0 ) { // first value after clear
+      offset = value;
+      step = fitStep(value, value);
+    }
+    const double scaled = (value - offset) / step;
+    if ( fabs(scaled) > maxCode() )
+      return false;
+    code = llround(scaled);
+  }
+
+  if (prec == Int16)
+    i16[idx] = code;
+  else
+    i32[idx] = code;
+  return true;
+
+}
+
+
+// Step which fits the range [mn, mx] with twice the range as headroom;
+// a fine one relative to the value if the range is empty.
+double SampleBuffer::fitStep(double mn, double mx) const {
+  const double fit = (mx - mn) / maxCode(); // half range * 2 of the headroom
+  if ( fit != 0.0 )
+    return fit;
+  const double mid = (mn + mx) / 2;
+  return ( mid == 0.0 ? 1.0 : fabs(mid) ) * ( prec == Int16 ? 1.0e-4 : 1.0e-9 );
+}
+
+
+// Chooses new offset and step so that both the content and the value (if
+// not NaN) fit, then re-encodes the content.
+void SampleBuffer::requantize(double value) {
+  QVector<double> decoded(points);
+  for (int idx = 0 ; idx < points ; idx++)
+    decoded[idx] = decode(idx);
+  LineStats st = lineStats(decoded.constData(), points);
+  double mn = st.min, mx = st.max;
+  if ( ! isnan(value) ) {
+    mn = isnan(mn) ? value : qMin(mn, value);
+    mx = isnan(mx) ? value : qMax(mx, value);
+  }
+  if ( isnan(mn) ) { // nothing to fit: the next value starts over
+    offset = step = 0.0;
+    return;
+  }
+  offset = (mn + mx) / 2;
+  step = fitStep(mn, mx);
+  for (int idx = 0 ; idx < points ; idx++)
+    encode(idx, decoded[idx]);
+}
+
+
+void SampleBuffer::setPrecision(Precision _prec) {
+  if ( _prec == prec )
+    return;
+  QVector<double> decoded(points);
+  for (int idx = 0 ; idx < points ; idx++)
+    decoded[idx] = decode(idx);
+  const int _head = head;
+  prec = _prec;
+  resize(points);
+  head = _head;
+  for (int idx = 0 ; idx < points ; idx++)
+    if ( ! encode(idx, decoded[idx]) ) {
+      requantize(decoded[idx]);
+      encode(idx, decoded[idx]);
+    }
+}
+
+
+double SampleBuffer::push(double value) {
+  if ( ! points )
+    return NAN;
+  head = (head + 1) % points;
+  // Once per turn of the ring the step narrows again if the content fits a
+  // step four times finer: a spike which has left the window no longer
+  // holds the resolution down.
+  if ( ! head && step != 0.0 && ( prec == Int32 || prec == Int16 ) ) {
+    const LineStats st = stats();
+    if ( ! isnan(st.min) && 4 * fitStep(st.min, st.max) < step )
+      requantize(NAN);
+  }
+  const double deleted = decode(head);
+  if ( ! encode(head, value) ) {
+    encode(head, NAN);
+    requantize(value);
+    encode(head, value);
+  }
+  return deleted;
+}
+
+
+double SampleBuffer::value(int age) const {
+  return ( age < 0 || age >= points )  ?  NAN  :  decode(index(age)) ;
+}
+
+
+// Min and max over all samples; the order in the ring does not matter.
+LineStats SampleBuffer::stats() const {
+
+  if (prec == Float64)
+    return lineStats(f64.constData(), points);
+
+  double mn = NAN, mx = NAN;
+  for (int idx = 0 ; idx < points ; idx++) {
+    const double val = decode(idx);
+    if ( isnan(val) )
+      continue;
+    if ( isnan(mn) || val < mn )
+      mn = val;
+    if ( isnan(mx) || val > mx )
+      mx = val;
+  }
+  LineStats st;
+  st.min = mn;
+  st.max = mx;
+  st.firstNaN = -1;
+  return st;
+
+}
+
+
+
+
+
+
+SampleAxis::SampleAxis() :
+  timestamped(false),
+  points(0),
+  head(0),
+  filled(0),
+  stride(1),
+  _newest(0.0),
+  span(0.0),
+  last(0)
+{}
+
+
+void SampleAxis::setTimestamped(bool ts) {
+  timestamped = ts;
+  resize(points);
+}
+
+
+void SampleAxis::resize(int _points, qint64 now) {
+  points = _points;
+  head = points ? points-1 : 0 ;
+  filled = 0;
+  last = now;
+  stride = 1;
+  stamps.clear();
+  if (timestamped) {
+    stamps.fill(now, points);
+    _newest = now;
+  } else {
+    _newest = points-1;
+  }
+}
+
+
+void SampleAxis::setStride(int _stride, double newest) {
+  stride = qMax(1, _stride);
+  if ( ! timestamped )
+    _newest = newest;
+}
+
+
+void SampleAxis::advance(qint64 msec) {
+  if ( ! points )
+    return;
+  head = (head + 1) % points;
+  filled = qMin(filled + 1, points);
+  last = msec;
+  if (timestamped) {
+    stamps[head] = msec;
+    _newest = msec;
+  } else {
+    _newest += stride;
+  }
+}
+
+
+int SampleAxis::age(double xx) const {
+
+  if ( ! filled )
+    return -1;
+
+  if ( ! timestamped ) {
+    const int ag = qRound( (_newest - xx) / stride );
+    return ( ag < 0 || ag >= filled )  ?  -1  :  ag ;
+  }
+
+  // times decrease with the age: binary search for the nearest one.
+  // Beyond the newest and the oldest samples by more than half the mean
+  // spacing there is none.
+  int lo = 0, hi = filled - 1;
+  const double spacing = hi  ?  ( x(lo) - x(hi) ) / hi  :  span / qMax(1, points - 1) ;
+  if ( xx > x(lo) + spacing / 2 || xx < x(hi) - spacing / 2 )
+    return -1;
+  if ( xx >= x(lo) )
+    return lo;
+  if ( xx <= x(hi) )
+    return hi;
+  while ( hi - lo > 1 ) {
+    const int mid = (lo + hi) / 2;
+    if ( x(mid) > xx )
+      lo = mid;
+    else
+      hi = mid;
+  }
+  return ( x(lo) - xx < xx - x(hi) )  ?  lo  :  hi ;
+
+}
+
+
+qint64 SampleAxis::time(int age) const {
+  if (timestamped)
+    return stamps[(head - age + points) % points];
+  return points  ?  last - qRound64(age * span / points)  :  last ;
+}
+
+
+double SampleAxis::seconds(int age) const {
+  if (timestamped)
+    return stamps[(head - age + points) % points] / 1000.0;
+  return points  ?  x(age) * span / points / stride / 1000.0  :  0.0 ;
+}
@@ -0,0 +1,122 @@
+#ifndef SAMPLEBUFFER_H
+#define SAMPLEBUFFER_H
+
+#include <QVector>
+#include <QString>
+
+#include "kernels.h"
+
+
+// Ring buffer of the samples of one signal, newest first (age 0).
+// The values are stored with the selected precision:
+//  Float64, Float32 - plain floating point;
+//  Int32, Int16     - quantized as offset + code*step. The step starts fine
+//                     and is widened (re-encoding the buffer) whenever a
+//                     value does not fit. Once per turn of the ring it is
+//                     narrowed again if the content allows a much finer
+//                     one, so the resolution follows the range of the
+//                     window: ~range/65000 for Int16.
+// NaN is kept in all precisions; the integer ones store +-inf as NaN.
+class SampleBuffer {
+
+public:
+
+  enum Precision {
+    Float64,
+    Float32,
+    Int32,
+    Int16
+  };
+
+  static int bytes(Precision prec);
+  static QString name(Precision prec);
+  static Precision fromName(const QString & nm, bool * ok=0);
+
+  SampleBuffer(Precision prec=Float64);
+
+  inline Precision precision() const {return prec;}
+  void setPrecision(Precision _prec); // re-encodes the content
+
+  inline int size() const {return points;}
+  void resize(int _points); // all NaN after resize
+  void clear();
+  double push(double value); // returns the value which was pushed out
+  double value(int age) const;
+  LineStats stats() const;
+  inline size_t memory() const {return (size_t) points * bytes(prec);}
+
+private:
+
+  Precision prec;
+  int points;
+  int head; // index of the newest sample
+  double offset;
+  double step;
+
+  QVector<double> f64;
+  QVector<float> f32;
+  QVector<qint32> i32;
+  QVector<qint16> i16;
+
+  inline int index(int age) const {return (head - age + points) % points;}
+  double decode(int idx) const;
+  bool encode(int idx, double value); // false if the value does not fit
+  qint64 maxCode() const;
+  void requantize(double value);
+  double fitStep(double mn, double mx) const;
+
+};
+
+
+
+// x coordinate of the samples, newest first (age 0). Either
+//  timestamped - ring of the int64 times (ms since epoch) the samples were
+//                taken at; x is that time; or
+//  index       - x derived from the age, no stored array. The samples are
+//                stride apart: a signal sampled on every stride-th tick of
+//                the chart keeps the x coordinates of the chart's axis.
+class SampleAxis {
+
+public:
+
+  SampleAxis();
+
+  void setTimestamped(bool ts); // clears
+  inline bool isTimestamped() const {return timestamped;}
+
+  inline int size() const {return points;}
+  inline int count() const {return filled;}
+  void resize(int _points, qint64 now=0);
+  inline void setSpan(double _span) {span = _span;}
+  inline double width() const {return span;} // of the window in ms
+  void setStride(int _stride, double newest); // of the index axis, after resize()
+  void advance(qint64 msec);
+
+  inline double x(int age) const {
+    return timestamped  ?
+          stamps[(head - age + points) % points]  :  _newest - age * stride ;
+  }
+  int age(double xx) const; // nearest sample, -1 if none
+  qint64 time(int age) const; // ms since epoch; interpolated on the index axis
+  double seconds(int age) const; // seconds on either axis, for rates
+  inline double newest() const {return _newest;}
+  inline double oldest() const {
+    return timestamped  ?  _newest - span  :  _newest - ( points - 1 ) * stride ;
+  }
+
+private:
+
+  bool timestamped;
+  int points;
+  int head;
+  int filled;
+  int stride;
+  double _newest;
+  double span; // width of the window in ms
+  qint64 last; // time of the newest sample
+  QVector<qint64> stamps;
+
+};
+
+
+#endif // SAMPLEBUFFER_H
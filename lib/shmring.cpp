@@ -0,0 +1,145 @@
+#include <QDebug>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+
+#include "shmring.h"
+
+
+struct ShmRing::Header {
+  char magic[8];
+  quint32 version;
+  quint32 state;
+  quint64 columns;
+  quint64 capacity;
+  quint64 namesOffset;
+  quint64 stampsOffset;
+  quint64 dataOffset;
+  quint64 seq;
+  quint64 count;
+};
+
+
+static inline size_t align64(size_t val) {
+  return (val + 63) & ~ (size_t) 63;
+}
+
+// shm_open wants a single leading slash
+static QByteArray shmName(const QString & name) {
+  return ( name.startsWith('/') ? name : '/' + name ).toLocal8Bit();
+}
+
+
+
+ShmRing::ShmRing() :
+  _capacity(0),
+  size(0),
+  header(0),
+  stamps(0),
+  data(0)
+{}
+
+ShmRing::~ShmRing() {
+  close();
+}
+
+
+bool ShmRing::open(const QString & name, const QStringList & pvs, int capacity) {
+
+  close();
+  if ( name.isEmpty() || capacity <= 0 )
+    return false;
+
+  const QByteArray names = pvs.join("\n").toUtf8();
+  const size_t namesOffset = align64(sizeof(Header));
+  const size_t stampsOffset = align64(namesOffset + names.size() + 1);
+  const size_t dataOffset = align64(stampsOffset + capacity * sizeof(qint64));
+  const size_t total = dataOffset + (size_t) capacity * pvs.size() * sizeof(double);
+
+  const QByteArray shm = shmName(name);
+  // a new segment rather than a resized one: readers of the old one see it
+  // abandoned instead of a layout changing under them.
+  shm_unlink(shm.constData());
+  const int fd = shm_open(shm.constData(), O_CREAT | O_EXCL | O_RDWR, 0644);
+  if ( fd < 0 ) {
+    qDebug() << "Can't create shared memory" << name << ":" << strerror(errno);
+    return false;
+  }
+  void * addr = MAP_FAILED;
+  if ( ftruncate(fd, total) == 0 )
+    addr = mmap(0, total, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  ::close(fd);
+  if ( addr == MAP_FAILED ) {
+    qDebug() << "Can't map shared memory" << name << ":" << strerror(errno);
+    shm_unlink(shm.constData());
+    return false;
+  }
+
+  _name = name;
+  _pvs = pvs;
+  _capacity = capacity;
+  size = total;
+  char * base = (char*) addr;
+  header = (Header*) base;
+  stamps = (qint64*) (base + stampsOffset);
+  data = (double*) (base + dataOffset);
+
+  memcpy(base + namesOffset, names.constData(), names.size());
+  for (int idx = 0 ; idx < capacity ; idx++)
+    stamps[idx] = 0;
+  for (size_t idx = 0 ; idx < (size_t) capacity * pvs.size() ; idx++)
+    data[idx] = NAN;
+  memcpy(header->magic, "TSCANSHM", 8);
+  header->version = 1;
+  header->columns = pvs.size();
+  header->capacity = capacity;
+  header->namesOffset = namesOffset;
+  header->stampsOffset = stampsOffset;
+  header->dataOffset = dataOffset;
+  header->seq = 0;
+  header->count = 0;
+  __atomic_store_n(&header->state, 1, __ATOMIC_RELEASE);
+
+  return true;
+
+}
+
+
+void ShmRing::close() {
+  if ( ! header )
+    return;
+  __atomic_store_n(&header->state, 0, __ATOMIC_RELEASE);
+  munmap(header, size);
+  shm_unlink(shmName(_name).constData());
+  header = 0;
+  stamps = 0;
+  data = 0;
+  size = 0;
+  _capacity = 0;
+  _pvs.clear();
+  _name.clear();
+}
+
+
+void ShmRing::append(qint64 msec, const QVector<double> & values) {
+
+  if ( ! header )
+    return;
+
+  const quint64 count = header->count;
+  const size_t idx = count % _capacity;
+  const int columns = qMin(values.size(), _pvs.size());
+
+  __atomic_store_n(&header->seq, header->seq + 1, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+  stamps[idx] = msec;
+  for (int col = 0 ; col < columns ; col++)
+    data[ (size_t) col * _capacity + idx ] = values[col];
+  __atomic_store_n(&header->count, count + 1, __ATOMIC_RELEASE);
+  __atomic_store_n(&header->seq, header->seq + 1, __ATOMIC_RELEASE);
+
+}
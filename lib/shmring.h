@@ -0,0 +1,68 @@
+#ifndef SHMRING_H
+#define SHMRING_H
+
+#include <QStringList>
+#include <QVector>
+
+
+// Live window in a POSIX shared-memory segment for readers on the same host.
+// Layout, native byte order, all offsets from the start of the segment:
+//
+//   0  char[8]   magic "TSCANSHM"
+//   8  uint32    version (1)
+//  12  uint32    state: 1 live, 0 abandoned - the writer has re-created the
+//                segment with another layout: unmap and open it again
+//  16  uint64    columns: number of signals
+//  24  uint64    capacity: rows in the ring
+//  32  uint64    offset of the PV names: '\n' separated UTF-8
+//  40  uint64    offset of the times: int64[capacity], ms since epoch
+//  48  uint64    offset of the values: float64[columns][capacity],
+//                one contiguous ring per column
+//  56  uint64    seq: sequence counter, odd while a row is being written
+//  64  uint64    count: rows written so far; row n is at index n % capacity
+//
+// Writer, once per row (release ordering between the steps):
+//   seq += 1; write time and values at count % capacity; count += 1; seq += 1.
+//
+// Readers take no lock and copy nothing they do not want:
+//  - one consistent row or the header: read seq (retry while odd), read,
+//    read seq again and retry if it changed;
+//  - a range of rows in place: read count c1 (with an even, unchanged seq),
+//    use rows [max(0, c1-capacity), c1), then read count c2: rows below
+//    c2-capacity were overwritten meanwhile and must be discarded.
+//
+// e.g. in Python:
+//   m = mmap.mmap(os.open("/dev/shm/tscan", os.O_RDONLY), 0, prot=mmap.PROT_READ)
+//   cols, cap, names, times, vals = struct.unpack_from("QQQQQ", m, 16)
+//   v = numpy.frombuffer(m, numpy.float64, cols*cap, vals).reshape(cols, cap)
+class ShmRing {
+
+public:
+
+  ShmRing();
+  ~ShmRing();
+
+  bool open(const QString & name, const QStringList & pvs, int capacity);
+  void close();
+  inline bool isOpen() const {return header;}
+  inline const QString & name() const {return _name;}
+  inline const QStringList & pvs() const {return _pvs;}
+  inline int capacity() const {return _capacity;}
+
+  void append(qint64 msec, const QVector<double> & values);
+
+private:
+
+  struct Header;
+  QString _name;
+  QStringList _pvs;
+  int _capacity;
+  size_t size;
+  Header * header;
+  qint64 * stamps;
+  double * data;
+
+};
+
+
+#endif // SHMRING_H
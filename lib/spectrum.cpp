@@ -0,0 +1,135 @@
+#include <math.h>
+
+#include "spectrum.h"
+
+
+static const double dynamicRange = 200.0; // dB kept below the peak
+
+
+QString Spectrum::name(Window window) {
+  switch (window) {
+    case Rectangular: return "rectangular";
+    case Hann:        return "hann";
+    case Hamming:     return "hamming";
+    case Blackman:    return "blackman";
+  }
+  return QString();
+}
+
+Spectrum::Window Spectrum::fromName(const QString & nm, bool * ok) {
+  const Window all[] = {Rectangular, Hann, Hamming, Blackman};
+  for (int idx = 0 ; idx < 4 ; idx++)
+    if ( nm == name(all[idx]) ) {
+      if (ok) *ok = true;
+      return all[idx];
+    }
+  if (ok) *ok = false;
+  return Hann;
+}
+
+
+Spectrum::Spectrum(QObject * parent) :
+  QThread(parent),
+  rate(0.0),
+  window(Hann),
+  averages(1)
+{}
+
+
+Spectrum::~Spectrum() {
+  wait();
+}
+
+
+bool Spectrum::compute(const QVector<double> & _samples, double _rate,
+                       Window _window, int _averages) {
+  if ( isRunning() )
+    return false;
+  samples = _samples;
+  rate = _rate;
+  window = _window;
+  averages = _averages;
+  start(QThread::LowPriority);
+  return true;
+}
+
+
+void Spectrum::run() {
+
+  _frequencies.clear();
+  _density.clear();
+  const int total = samples.size();
+  if ( total < 4 || ! ( rate > 0.0 ) )
+    return;
+
+  // segments of length len overlapping by half: averages * len/2 + len/2 = total
+  const int segs = qBound(1, averages, total / 2 - 1);
+  const int len = 2 * total / (segs + 1);
+  const int hop = segs > 1  ?  (total - len) / (segs - 1)  :  0 ;
+
+  taper.resize(len);
+  double power = 0.0; // of the taper, for the density scale
+  for (int idx = 0 ; idx < len ; idx++) {
+    const double phase = 2.0 * M_PI * idx / (len - 1);
+    switch (window) {
+      case Rectangular: taper[idx] = 1.0; break;
+      case Hann:        taper[idx] = 0.5 - 0.5 * cos(phase); break;
+      case Hamming:     taper[idx] = 0.54 - 0.46 * cos(phase); break;
+      case Blackman:    taper[idx] = 0.42 - 0.5 * cos(phase) + 0.08 * cos(2.0 * phase); break;
+    }
+    power += taper[idx] * taper[idx];
+  }
+
+  const int nfft = FFT::size(len);
+  fft.resize(nfft);
+  buffer.resize(nfft);
+  const int bins = nfft / 2 + 1;
+  QVector<double> accum(bins, 0.0);
+  int used = 0; // segments with data
+
+  for (int seg = 0 ; seg < segs ; seg++) {
+    const double * vals = samples.constData() + seg * hop;
+    double mean = 0.0;
+    int valid = 0;
+    for (int idx = 0 ; idx < len ; idx++)
+      if ( ! isnan(vals[idx]) ) {
+        mean += vals[idx];
+        valid++;
+      }
+    if ( ! valid )
+      continue;
+    used++;
+    mean /= valid;
+    for (int idx = 0 ; idx < len ; idx++)
+      buffer[idx] = isnan(vals[idx])  ?  0.0  :  ( vals[idx] - mean ) * taper[idx] ;
+    for (int idx = len ; idx < nfft ; idx++)
+      buffer[idx] = 0.0;
+    fft.forward(buffer.data());
+    for (int bin = 0 ; bin < bins ; bin++)
+      accum[bin] += std::norm(buffer[bin]);
+  }
+  if ( ! used || power == 0.0 )
+    return;
+
+  // one-sided: all but the DC and Nyquist bins have their mirror added;
+  // the DC bin is left out since the mean was removed
+  const double scale = 1.0 / ( used * rate * power );
+  _frequencies.resize(bins - 1);
+  _density.resize(bins - 1);
+  double peak = -INFINITY;
+  for (int bin = 1 ; bin < bins ; bin++) {
+    const double psd = accum[bin] * scale * ( bin == bins - 1  ?  1.0  :  2.0 );
+    _frequencies[bin - 1] = bin * rate / nfft;
+    _density[bin - 1] = 10.0 * log10(psd);
+    if ( _density[bin - 1] > peak )
+      peak = _density[bin - 1];
+  }
+  if ( isinf(peak) ) {  // flat signal
+    _density.fill(0.0);
+    return;
+  }
+  for (int bin = 0 ; bin < _density.size() ; bin++)
+    if ( ! ( _density[bin] >= peak - dynamicRange ) )
+      _density[bin] = peak - dynamicRange;
+
+}
@@ -0,0 +1,64 @@
+#ifndef SPECTRUM_H
+#define SPECTRUM_H
+
+#include <QThread>
+#include <QVector>
+#include <QString>
+
+#include "fft.h"
+
+
+// Power spectral density of a window of samples, computed on its own
+// thread so that long windows do not delay the scan. Averaging follows
+// Welch: the window is split into the given number of segments overlapping
+// by half, each one has its mean removed, is tapered, zero-padded to a
+// power of two and transformed, and the periodograms are averaged, which
+// trades frequency resolution for a less noisy estimate. NaN samples count
+// as the segment mean. The result is one-sided, in dB of (units^2/Hz).
+class Spectrum : public QThread {
+  Q_OBJECT;
+
+public:
+
+  enum Window {
+    Rectangular,
+    Hann,
+    Hamming,
+    Blackman
+  };
+
+  static QString name(Window window);
+  static Window fromName(const QString & nm, bool * ok=0);
+
+  Spectrum(QObject * parent=0);
+  ~Spectrum();
+
+  // false if a computation is still running; samples are oldest first,
+  // rate in samples per second
+  bool compute(const QVector<double> & samples, double rate,
+               Window window, int averages);
+
+  // valid once finished() is emitted and until the next compute()
+  inline const QVector<double> & frequencies() const {return _frequencies;}
+  inline const QVector<double> & density() const {return _density;}
+
+protected:
+
+  virtual void run();
+
+private:
+
+  QVector<double> samples;
+  double rate;
+  Window window;
+  int averages;
+  FFT fft;
+  QVector<Complex> buffer;
+  QVector<double> taper;
+  QVector<double> _frequencies;
+  QVector<double> _density;
+
+};
+
+
+#endif // SPECTRUM_H
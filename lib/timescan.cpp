@@ -3,17 +3,28 @@
 #include <QDir>
 #include <QPrinter>
 #include <QDate>
+#include <QDateTime>
+#include <QHash>
 #include <QPrintDialog>
 #include <QTime>
+#include <QFontDatabase>
+#include <QRegExp>
 #include <math.h>
+#include <string.h>
 
 #include "timescan.h"
 #include "ui_timescan.h"
+#include "kernels.h"
 
 #include <qwt_scale_draw.h>
 #include <qwt_scale_engine.h>
 #include <qwt_symbol.h>
 #include <qwt_plot_renderer.h>
+#include <qwt_raster_data.h>
+#include <qwt_color_map.h>
+#if QWT_VERSION >= 0x060100
+#include <qwt_date_scale_engine.h>
+#endif
 
 
 
@@ -32,6 +43,251 @@ private:
 };
 
 
+// Labels of the real time axis (x in ms since epoch). Unlike the label cache
+// of QwtAbstractScaleDraw, which is dropped on every new scale division,
+// this one lives as long as the axis, so scrolling only formats the labels
+// of the ticks which were not shown before.
+class RealTimeScaleDraw: public QwtScaleDraw {
+public:
+  RealTimeScaleDraw(): QwtScaleDraw() {}
+  virtual QwtText label(double v) const {
+    const qint64 msec = qRound64(v);
+    QHash<qint64, QwtText>::const_iterator found = labels.constFind(msec);
+    if ( found != labels.constEnd() )
+      return *found;
+    if ( labels.size() > 1024 )
+      labels.clear();
+    const QwtText text = QDateTime::fromMSecsSinceEpoch(msec).toString("hh:mm:ss");
+    labels.insert(msec, text);
+    return text;
+  }
+private:
+  mutable QHash<qint64, QwtText> labels;
+};
+
+
+
+// Curve of a signal read straight from its sample buffer. The x coordinate
+// comes from the axis and the optional normalization y=(v-offset)*scale+shift
+// is applied on the fly, so no copies of the buffer are kept.
+class SignalSeries: public QwtSeriesData<QPointF> {
+public:
+  SignalSeries(const SampleBuffer * _buf, const SampleAxis * _axis, const int * _count,
+               const double * _min, const double * _max):
+    buf(_buf), axis(_axis), count(_count), mn(_min), mx(_max),
+    offset(0.0), scale(1.0), shift(0.0) {}
+  virtual size_t size() const {
+    return *count;
+  }
+  virtual QPointF sample(size_t i) const {
+    return QPointF(axis->x(i), transform(buf->value(i)));
+  }
+  virtual QRectF boundingRect() const {
+    if ( ! *count || isnan(*mn) )
+      return QRectF();
+    const double y0 = transform(*mn), y1 = transform(*mx);
+    const double x0 = axis->x(*count-1);
+    return QRectF( x0, qMin(y0, y1), axis->x(0) - x0, qAbs(y1-y0) );
+  }
+  void setTransform(double _offset, double _scale, double _shift) {
+    offset = _offset;
+    scale = _scale;
+    shift = _shift;
+  }
+private:
+  inline double transform(double v) const {return (v - offset) * scale + shift;}
+  const SampleBuffer * buf;
+  const SampleAxis * axis;
+  const int * count;
+  const double * mn;
+  const double * mx;
+  double offset;
+  double scale;
+  double shift;
+};
+
+
+// Min/max band over the sample buffers of the signal.
+class EnvelopeData: public QwtSeriesData<QwtIntervalSample> {
+public:
+  EnvelopeData(const SampleBuffer * _low, const SampleBuffer * _high,
+               const SampleAxis * _axis, const int * _count,
+               const double * _min, const double * _max):
+    low(_low), high(_high), axis(_axis), count(_count), mn(_min), mx(_max) {}
+  virtual size_t size() const {
+    return low->size() ? *count : 0 ;
+  }
+  virtual QwtIntervalSample sample(size_t i) const {
+    return QwtIntervalSample(axis->x(i), low->value(i), high->value(i));
+  }
+  virtual QRectF boundingRect() const {
+    if ( ! size() || isnan(*mn) )
+      return QRectF();
+    const double x0 = axis->x(*count-1);
+    return QRectF(x0, *mn, axis->x(0) - x0, *mx - *mn);
+  }
+private:
+  const SampleBuffer * low;
+  const SampleBuffer * high;
+  const SampleAxis * axis;
+  const int * count;
+  const double * mn;
+  const double * mx;
+};
+
+
+// Curve which leaves out the symbols when they would pile up: once the
+// points are a few pixels apart the symbols merge into a band, and drawing
+// them costs most of the replot. The density is checked whenever the whole
+// curve is drawn, with some hysteresis, and the choice is kept for the
+// newest segments painted in between so that the canvas stays consistent.
+// The symbols come back as soon as the points spread out again.
+class SignalCurve: public QwtPlotCurve {
+public:
+  SignalCurve() : symbolsShown(true) {}
+protected:
+  virtual void drawSymbols(QPainter * painter, const QwtSymbol & symbol,
+                           const QwtScaleMap & xMap, const QwtScaleMap & yMap,
+                           const QRectF & canvasRect, int from, int to) const {
+    const int size = dataSize();
+    if ( from == 0 && to == size - 1 ) {
+      const double spacing = size < 2  ?  INFINITY  :
+          qAbs( xMap.transform(sample(0).x()) - xMap.transform(sample(size-1).x()) ) / (size - 1);
+      const double width = symbol.size().width();
+      if ( symbolsShown  ?  spacing < width / 3  :  spacing >= width / 2 )
+        symbolsShown = ! symbolsShown;
+    }
+    if (symbolsShown)
+      QwtPlotCurve::drawSymbols(painter, symbol, xMap, yMap, canvasRect, from, to);
+  }
+private:
+  mutable bool symbolsShown;
+};
+
+
+// The symbol is rendered once into a pixmap which is then copied for every
+// point instead of painting an antialiased ellipse each time.
+static QwtSymbol * cachedSymbol(QwtSymbol * symbol) {
+  #if QWT_VERSION >= 0x060100
+  symbol->setCachePolicy(QwtSymbol::Cache);
+  #endif
+  return symbol;
+}
+
+
+// A signal sampled on every n-th tick keeps its samples on an axis of its
+// own with one point per n ticks of the chart (and one more, so that it
+// still holds the row of the chart leaving the window), the x coordinates
+// being those of the chart's axis at the ticks it was sampled on.
+static int sparsePoints(int points, int every) {
+  return every > 1  ?  ( points + every - 1 ) / every + 1  :  points ;
+}
+
+
+// Waterfall of an array signal straight from its ring buffer:
+// x is the same coordinate as the curves use, y is the element index.
+class WaterfallData: public QwtRasterData {
+public:
+  WaterfallData(const Plane * _ring, const int * _head, const int * _filled,
+                const qint64 * _written, const SampleAxis * _axis):
+    ring(_ring), head(_head), filled(_filled), written(_written), axis(_axis) {}
+  virtual double value(double xx, double yy) const {
+    int age;
+    return cell(row(xx, &age), yy);
+  }
+  // row of the ring shown at xx, -1 if none; age is its age on the axis
+  int row(double xx, int * age) const {
+    const int points = ring->extent(0);
+    *age = axis->age(xx);
+    if ( ! points || *age < 0 || *age >= *filled )
+      return -1;
+    return (*head - *age + points) % points;
+  }
+  double cell(int rw, double yy) const {
+    const int element = (int) floor(yy);
+    if ( rw < 0 || element < 0 || element >= ring->extent(1) )
+      return NAN;
+    return (*ring)(rw, element);
+  }
+  inline qint64 rowsWritten() const {return *written;}
+  void setBounds(const QwtInterval & xi, const QwtInterval & yi, const QwtInterval & zi) {
+    intervals[Qt::XAxis] = xi;
+    intervals[Qt::YAxis] = yi;
+    intervals[Qt::ZAxis] = zi;
+    #if QWT_VERSION < 0x060200
+    setInterval(Qt::XAxis, xi);
+    setInterval(Qt::YAxis, yi);
+    setInterval(Qt::ZAxis, zi);
+    #endif
+  }
+  #if QWT_VERSION >= 0x060200
+  virtual QwtInterval interval(Qt::Axis ax) const {
+    return intervals[ax];
+  }
+  #endif
+private:
+  const Plane * ring;
+  const int * head;
+  const int * filled;
+  const qint64 * written;
+  const SampleAxis * axis;
+  QwtInterval intervals[3];
+};
+
+
+// Spectrogram of a WaterfallData which keeps its image from one tick to the
+// next. While the axis, the z range and the size stay the same only the
+// pixel columns showing another row than before, or a row written since,
+// are rendered again: a page of the axis or a new z range redraws it all.
+class WaterfallItem: public QwtPlotSpectrogram {
+public:
+  WaterfallItem() : drawnData(0), drawnWrites(0) {}
+  virtual QImage renderImage(const QwtScaleMap & xMap, const QwtScaleMap & yMap,
+                             const QRectF & area, const QSize & imageSize) const {
+    const WaterfallData * wd = static_cast<const WaterfallData*>(data());
+    if ( imageSize.isEmpty() || ! wd || ! colorMap() )
+      return QImage();
+    const QwtInterval zi = wd->interval(Qt::ZAxis);
+    if ( image.size() != imageSize || wd != drawnData || area != drawnArea || zi != drawnZ ||
+         ! sameMap(xMap, drawnX) || ! sameMap(yMap, drawnY) ) {
+      image = QImage(imageSize, QImage::Format_ARGB32);
+      drawnRows.fill(-2, imageSize.width()); // no row: all columns are drawn
+      drawnData = wd;
+      drawnArea = area;
+      drawnZ = zi;
+      drawnX = xMap;
+      drawnY = yMap;
+    }
+    const qint64 fresh = wd->rowsWritten() - drawnWrites; // ages of the new rows
+    drawnWrites = wd->rowsWritten();
+    for (int xx = 0 ; xx < imageSize.width() ; xx++) {
+      int age;
+      const int rw = wd->row(xMap.invTransform(xx), &age);
+      if ( rw == drawnRows[xx] && ( rw < 0 || age >= fresh ) )
+        continue;
+      drawnRows[xx] = rw;
+      for (int yy = 0 ; yy < imageSize.height() ; yy++)
+        reinterpret_cast<QRgb*>(image.scanLine(yy))[xx] =
+            colorMap()->rgb(zi, wd->cell(rw, yMap.invTransform(yy)));
+    }
+    return image;
+  }
+private:
+  static bool sameMap(const QwtScaleMap & one, const QwtScaleMap & other) {
+    return one.s1() == other.s1() && one.s2() == other.s2() &&
+           one.p1() == other.p1() && one.p2() == other.p2();
+  }
+  mutable QImage image;
+  mutable QVector<int> drawnRows; // of every pixel column, -1 for none
+  mutable const WaterfallData * drawnData;
+  mutable QRectF drawnArea;
+  mutable QwtInterval drawnZ;
+  mutable QwtScaleMap drawnX;
+  mutable QwtScaleMap drawnY;
+  mutable qint64 drawnWrites;
+};
+
+
 
 const QString QChartMX::qtiCommand = QChartMX::initQti();
 const QStringList QChartMX::knownDetectors = QChartMX::initDetectors();
@@ -43,7 +299,10 @@ QChartMX::QChartMX(QWidget *parent) :
     QWidget(parent),
     ui(new Ui::TimeScan),
     timer(new QTimer(this)),
-    timeData()
+    timeAxis(),
+    captureLeft(0),
+    captureEvents(0),
+    gettingData(false)
 {
 
   colorsLeft
@@ -66,6 +325,18 @@ QChartMX::QChartMX(QWidget *parent) :
   ui->plot->setAutoReplot(false);
   ui->plot->setAxisMaxMinor(QwtPlot::yLeft,  10);
   ui->qtiResults->setVisible( ! qtiCommand.isEmpty() );
+  ui->exportProgress->setVisible(false);
+  ui->cancelExport->setVisible(false);
+  ui->snapshot->setEnabled( GroupRead::isAvailable() );
+  directPainter = new QwtPlotDirectPainter(this);
+  directPainter->setAttribute(QwtPlotDirectPainter::CopyBackingStore, true);
+  zoomer = new QwtPlotZoomer(ui->plot->canvas());
+  zoomer->setEnabled(false);
+  connect(zoomer, SIGNAL(zoomed(QRectF)), SLOT(loadHistory()));
+  panner = new QwtPlotPanner(ui->plot->canvas());
+  panner->setMouseButton(Qt::MidButton);
+  panner->setEnabled(false);
+  connect(panner, SIGNAL(panned(int,int)), SLOT(loadHistory()));
   grid = new QwtPlotGrid;
   grid->enableXMin(true);
   grid->enableYMin(true);
@@ -84,12 +355,79 @@ QChartMX::QChartMX(QWidget *parent) :
 
   setGridVisible(isGridVisible());
 
+  ui->perfReport->setFont(QFontDatabase::systemFont(QFontDatabase::FixedFont));
+  ui->perfContent->setVisible(ui->perfPanel->isChecked());
+  connect(ui->perfPanel, SIGNAL(toggled(bool)), ui->perfContent, SLOT(setVisible(bool)));
+
   connect(ui->addSignal, SIGNAL(clicked()), SLOT(addSignal()));
   connect(ui->startStop, SIGNAL(clicked()), SLOT(startStop()));
   connect(ui->browseSaveDir, SIGNAL(clicked()), SLOT(browseAutoSave()));
   connect(ui->printResult, SIGNAL(clicked()), SLOT(printResult()));
   connect(ui->saveResult, SIGNAL(clicked()), SLOT(saveResult()));
   connect(ui->qtiResults, SIGNAL(clicked()), SLOT(openQti()));
+  connect(ui->freeze, SIGNAL(toggled(bool)), SLOT(setFrozen(bool)));
+
+  exporter = new Exporter(this);
+  connect(exporter, SIGNAL(progress(int)), ui->exportProgress, SLOT(setValue(int)));
+  connect(exporter, SIGNAL(finished()), SLOT(exportFinished()));
+  connect(ui->cancelExport, SIGNAL(clicked()), exporter, SLOT(cancel()));
+
+  publisher = new Publisher(this);
+  connect(publisher, SIGNAL(replayRequested(int)), SLOT(replayTo(int)));
+  connect(ui->publish, SIGNAL(editingFinished()), SLOT(applyPublish()));
+  connect(ui->sharedMemory, SIGNAL(editingFinished()), SLOT(applySharedMemory()));
+  connect(ui->triggerMode, SIGNAL(currentIndexChanged(int)), SLOT(applyTrigger()));
+  connect(ui->triggerCondition, SIGNAL(editingFinished()), SLOT(applyTrigger()));
+  connect(ui->triggerLevel, SIGNAL(valueChanged(double)), SLOT(applyTrigger()));
+  connect(ui->triggerPre, SIGNAL(valueChanged(int)), SIGNAL(configurationChanged()));
+  connect(ui->triggerPost, SIGNAL(valueChanged(int)), SIGNAL(configurationChanged()));
+
+  spectrum = new Spectrum(this);
+  connect(spectrum, SIGNAL(finished()), SLOT(showSpectrum()));
+  spectrumPlot = new QwtPlot(this);
+  spectrumPlot->setAutoReplot(false);
+  spectrumPlot->setAxisTitle(QwtPlot::xBottom, "Frequency, Hz");
+  spectrumPlot->setAxisTitle(QwtPlot::yLeft, "PSD, dB");
+  spectrumPlot->setVisible(false);
+  spectrumCurve = new QwtPlotCurve;
+  spectrumCurve->attach(spectrumPlot);
+  ui->splitter_2->addWidget(spectrumPlot);
+  connect(ui->spectrumSignal, SIGNAL(editingFinished()), SLOT(applySpectrum()));
+  connect(ui->spectrumWindow, SIGNAL(currentIndexChanged(int)), SLOT(applySpectrum()));
+  connect(ui->spectrumAverages, SIGNAL(valueChanged(int)), SLOT(applySpectrum()));
+
+  correlationUpdates = 0;
+  correlationTable = new QTableWidget(this);
+  correlationTable->setEditTriggers(QAbstractItemView::NoEditTriggers);
+  correlationTable->setVisible(false);
+  ui->splitter_2->addWidget(correlationTable);
+  connect(ui->correlation, SIGNAL(toggled(bool)), SLOT(setCorrelationShown(bool)));
+
+  lagScan = new LagScan(this);
+  connect(lagScan, SIGNAL(finished()), SLOT(showLagScan()));
+  lagPlot = new QwtPlot(this);
+  lagPlot->setAutoReplot(false);
+  lagPlot->setAxisTitle(QwtPlot::xBottom, "Lag, s");
+  lagPlot->setAxisTitle(QwtPlot::yLeft, "Correlation");
+  lagPlot->setAxisScale(QwtPlot::yLeft, -1.0, 1.0);
+  lagPlot->setVisible(false);
+  lagCurve = new QwtPlotCurve;
+  lagCurve->attach(lagPlot);
+  ui->splitter_2->addWidget(lagPlot);
+  connect(ui->lagSignals, SIGNAL(editingFinished()), SLOT(applyLagScan()));
+
+  barrier = new ConnectBarrier(this);
+  connect(barrier, SIGNAL(done(bool)), SLOT(startScan()));
+  connect(ui->connectTimeout, SIGNAL(valueChanged(double)), SIGNAL(configurationChanged()));
+  connect(ui->onChange, SIGNAL(toggled(bool)), SLOT(applyDeadband()));
+
+  renderer = new SnapshotRenderer(this);
+  connect(renderer, SIGNAL(finished()), SLOT(renderFinished()));
+  renderTimer = new QTimer(this);
+  connect(renderTimer, SIGNAL(timeout()), SLOT(autoRender()));
+  connect(ui->renderInterval, SIGNAL(valueChanged(double)), SLOT(applyRender()));
+  connect(ui->renderFormat, SIGNAL(currentIndexChanged(int)), SLOT(applyRender()));
+
   connect(ui->saveDir, SIGNAL(textChanged(QString)), SLOT(setSaveDir(QString)));
   connect(ui->saveName, SIGNAL(textChanged(QString)), SLOT(setSaveName(QString)));
   connect(ui->autoName, SIGNAL(toggled(bool)), SLOT(setAutoName(bool)));
@@ -103,8 +441,20 @@ QChartMX::QChartMX(QWidget *parent) :
   connect(ui->max, SIGNAL(editingFinished()), SLOT(setRanges()));
   connect(ui->interval, SIGNAL(valueChanged(double)), SLOT(setInterval(double)));
   connect(ui->period, SIGNAL(valueChanged(double)), SLOT(setPeriod(double)));
-
-  connect(timer, SIGNAL(timeout()), SLOT(getData()));
+  connect(ui->perfToFile, SIGNAL(toggled(bool)), SIGNAL(configurationChanged()));
+  connect(ui->snapshot, SIGNAL(toggled(bool)), SIGNAL(configurationChanged()));
+  connect(ui->aggregate, SIGNAL(toggled(bool)), SLOT(setAggregated(bool)));
+  connect(ui->aggregate, SIGNAL(toggled(bool)), ui->aggregateColumns, SLOT(setEnabled(bool)));
+  connect(ui->aggregateColumns, SIGNAL(toggled(bool)), SIGNAL(configurationChanged()));
+  ui->aggregateColumns->setEnabled(isAggregated());
+  connect(ui->storage, SIGNAL(currentIndexChanged(int)), SLOT(applyStorage()));
+  connect(ui->storage, SIGNAL(currentIndexChanged(int)), SIGNAL(configurationChanged()));
+  connect(ui->memoryBudget, SIGNAL(valueChanged(double)), SLOT(applyStorage()));
+  connect(ui->memoryBudget, SIGNAL(valueChanged(double)), SIGNAL(configurationChanged()));
+  connect(ui->realTime, SIGNAL(toggled(bool)), SLOT(setRealTime(bool)));
+
+  connect(timer, SIGNAL(timeout()), SLOT(requestData()));
+  connect(&groupRead, SIGNAL(ready()), SLOT(getData()));
 
   setSaveDir(QDir::homePath());
 
@@ -156,6 +506,99 @@ bool QChartMX::isContinious() const {
   return ui->cont->isChecked();
 }
 
+bool QChartMX::isSnapshotRead() const {
+  return GroupRead::isAvailable() && ui->snapshot->isChecked();
+}
+
+bool QChartMX::isAggregated() const {
+  return ui->aggregate->isChecked();
+}
+
+bool QChartMX::isAggregateRecorded() const {
+  return isAggregated() && ui->aggregateColumns->isChecked();
+}
+
+QString QChartMX::storage() const {
+  return ui->storage->currentText();
+}
+
+double QChartMX::memoryBudget() const {
+  return ui->memoryBudget->value();
+}
+
+bool QChartMX::isRealTime() const {
+  return ui->realTime->isChecked();
+}
+
+QString QChartMX::publishAddress() const {
+  return ui->publish->text();
+}
+
+QString QChartMX::sharedMemory() const {
+  return ui->sharedMemory->text();
+}
+
+QString QChartMX::triggerMode() const {
+  return ui->triggerMode->currentText();
+}
+
+QString QChartMX::triggerCondition() const {
+  return ui->triggerCondition->text();
+}
+
+double QChartMX::triggerLevel() const {
+  return ui->triggerLevel->value();
+}
+
+int QChartMX::triggerPre() const {
+  return ui->triggerPre->value();
+}
+
+int QChartMX::triggerPost() const {
+  return ui->triggerPost->value();
+}
+
+QString QChartMX::spectrumSignal() const {
+  return ui->spectrumSignal->text();
+}
+
+QString QChartMX::spectrumWindow() const {
+  return ui->spectrumWindow->currentText();
+}
+
+int QChartMX::spectrumAverages() const {
+  return ui->spectrumAverages->value();
+}
+
+bool QChartMX::isCorrelationShown() const {
+  return ui->correlation->isChecked();
+}
+
+QString QChartMX::lagSignals() const {
+  return ui->lagSignals->text();
+}
+
+double QChartMX::renderInterval() const {
+  return ui->renderInterval->value();
+}
+
+QString QChartMX::renderFormat() const {
+  return ui->renderFormat->currentText();
+}
+
+double QChartMX::connectTimeout() const {
+  return ui->connectTimeout->value();
+}
+
+bool QChartMX::isOnChangeRecorded() const {
+  return ui->onChange->isChecked();
+}
+
+QString QChartMX::signalStorage(const QString & pvName) const {
+  Signal * sig = signal(pvName);
+  return sig  ?  SampleBuffer::name(sig->precision())  :  QString() ;
+}
+
 QString QChartMX::saveDir() const {
   QString dn = ui->saveDir->text();
   if ( ! dn.endsWith('/') )
@@ -204,6 +647,14 @@ bool QChartMX::isControlCollapsed() const {
   return ui->control->isVisible();
 }
 
+bool QChartMX::isFrozen() const {
+  return ui->freeze->isChecked();
+}
+
+bool QChartMX::isPerformanceRecorded() const {
+  return ui->perfToFile->isChecked();
+}
+
 
 QStringList QChartMX::allSignals() const  {
   QStringList sigs;
@@ -212,6 +663,14 @@ QStringList QChartMX::allSignals() const  {
   return sigs;
 }
 
+// Channels of the grouped read: empty for the derived signals.
+QStringList QChartMX::caSignals() const  {
+  QStringList sigs;
+  foreach (Signal * sig, signalsE)
+    sigs << ( sig->isDerived() ? QString() : sig->pv() );
+  return sigs;
+}
+
 bool QChartMX::isRunning() const  {
   return timer->isActive();
 }
@@ -242,6 +701,173 @@ void QChartMX::setContinious(bool val) {
   ui->cont->setChecked(val);
 }
 
+void QChartMX::setSnapshotRead(bool val) {
+  ui->snapshot->setChecked(val);
+}
+
+void QChartMX::setAggregated(bool val) {
+  if ( sender() != ui->aggregate ) {
+    ui->aggregate->setChecked(val);
+    return;
+  }
+  foreach (Signal * sig, signalsE)
+    sig->setAggregated(val);
+  applyStorage();
+  ui->plot->replot();
+  emit configurationChanged();
+}
+
+void QChartMX::setAggregateRecorded(bool val) {
+  ui->aggregateColumns->setChecked(val);
+}
+
+void QChartMX::setStorage(const QString & val) {
+  const int idx = ui->storage->findText(val);
+  if ( idx >= 0 )
+    ui->storage->setCurrentIndex(idx);
+}
+
+void QChartMX::setMemoryBudget(double val) {
+  ui->memoryBudget->setValue(val);
+}
+
+void QChartMX::setPublishAddress(const QString & val) {
+  ui->publish->setText(val);
+  applyPublish();
+}
+
+void QChartMX::setSharedMemory(const QString & val) {
+  ui->sharedMemory->setText(val);
+  applySharedMemory();
+}
+
+void QChartMX::setTriggerMode(const QString & val) {
+  const int idx = ui->triggerMode->findText(val);
+  if ( idx >= 0 )
+    ui->triggerMode->setCurrentIndex(idx);
+}
+
+void QChartMX::setTriggerCondition(const QString & val) {
+  ui->triggerCondition->setText(val);
+  applyTrigger();
+}
+
+void QChartMX::setTriggerLevel(double val) {
+  ui->triggerLevel->setValue(val);
+}
+
+void QChartMX::setTriggerPre(int val) {
+  ui->triggerPre->setValue(val);
+}
+
+void QChartMX::setTriggerPost(int val) {
+  ui->triggerPost->setValue(val);
+}
+
+void QChartMX::setSpectrumSignal(const QString & val) {
+  ui->spectrumSignal->setText(val);
+  applySpectrum();
+}
+
+void QChartMX::setSpectrumWindow(const QString & val) {
+  const int idx = ui->spectrumWindow->findText(val);
+  if ( idx >= 0 )
+    ui->spectrumWindow->setCurrentIndex(idx);
+}
+
+void QChartMX::setSpectrumAverages(int val) {
+  ui->spectrumAverages->setValue(val);
+}
+
+void QChartMX::setCorrelationShown(bool val) {
+  if ( sender() != ui->correlation ) {
+    ui->correlation->setChecked(val);
+    return;
+  }
+  correlationTable->setVisible(val);
+  correlationSignals.clear();
+  emit configurationChanged();
+}
+
+void QChartMX::setLagSignals(const QString & val) {
+  ui->lagSignals->setText(val);
+  applyLagScan();
+}
+
+void QChartMX::setRenderInterval(double val) {
+  ui->renderInterval->setValue(val);
+}
+
+void QChartMX::setRenderFormat(const QString & val) {
+  const int idx = ui->renderFormat->findText(val);
+  if ( idx >= 0 )
+    ui->renderFormat->setCurrentIndex(idx);
+}
+
+void QChartMX::setConnectTimeout(double val) {
+  ui->connectTimeout->setValue(val);
+}
+
+void QChartMX::setOnChangeRecorded(bool val) {
+  ui->onChange->setChecked(val);
+}
+
+void QChartMX::setRealTime(bool val) {
+  if ( sender() != ui->realTime ) {
+    ui->realTime->setChecked(val);
+    return;
+  }
+  preparePlot();
+  emit configurationChanged();
+}
+
+int QChartMX::signalEvery(const QString & pvName) const {
+  Signal * sig = signal(pvName);
+  return sig  ?  sig->sampledEvery()  :  1 ;
+}
+
+void QChartMX::setSignalEvery(const QString & pvName, int every) {
+  Signal * sig = signal(pvName);
+  if (sig)
+    sig->everyBox->setValue(every); // applySampling() from its signal
+}
+
+void QChartMX::applySampling() {
+  preparePlot();
+  emit configurationChanged();
+}
+
+QString QChartMX::signalDeadband(const QString & pvName) const {
+  Signal * sig = signal(pvName);
+  return sig  ?  sig->deadband()  :  QString() ;
+}
+
+void QChartMX::setSignalDeadband(const QString & pvName, const QString & deadband) {
+  Signal * sig = signal(pvName);
+  if (sig)
+    sig->deadbandEdit->setText(deadband); // applyDeadband() from its signal
+}
+
+// The deadbands apply only with the recording on change, which changes the
+// format of the data file.
+void QChartMX::applyDeadband() {
+  foreach (Signal * sig, signalsE) {
+    sig->deadbandEdit->setEnabled(isOnChangeRecorded());
+    sig->deadbandEdit->setStyleSheet( sig->isDeadbandValid()  ?  goodStyle  :  badStyle );
+  }
+  emit configurationChanged();
+}
+
+void QChartMX::setSignalStorage(const QString & pvName, const QString & precision) {
+  Signal * sig = signal(pvName);
+  if ( ! sig )
+    return;
+  bool ok;
+  SampleBuffer::Precision prec = SampleBuffer::fromName(precision, &ok);
+  sig->forcedPrecision = ok ? prec : -1 ;
+  applyStorage();
+}
+
 void QChartMX::setSaveDir(const QString & val) {
   if (sender() != ui->saveDir ) {
     ui->saveDir->setText(val);
@@ -327,9 +953,22 @@ void QChartMX::addSignal(const QString & pvName) {
   sg->curve->setPen(pen);
 
   QwtSymbol * symbol = new QwtSymbol(sg->curve->symbol()->style(), sg->curve->symbol()->brush(), pen, sg->curve->symbol()->size());
-  sg->curve->setSymbol(symbol);
+  sg->curve->setSymbol(cachedSymbol(symbol));
+
+  QColor envcolor = sigcolor;
+  envcolor.setAlpha(48);
+  sg->envelope->setBrush(envcolor);
+  QPen historyPen = pen;
+  historyPen.setWidth(1);
+  historyPen.setStyle(Qt::DashLine);
+  sg->historyCurve->setPen(historyPen);
+  sg->setAggregated(isAggregated());
 
   connect(sg->rem, SIGNAL(clicked()), SLOT(removeSignal()));
+  connect(sg->everyBox, SIGNAL(valueChanged(int)), SLOT(applySampling()));
+  connect(sg->deadbandEdit, SIGNAL(textChanged(QString)), SLOT(applyDeadband()));
+  connect(sg->sig, SIGNAL(editTextChanged(QString)), SLOT(applyTrigger()));
+  sg->deadbandEdit->setEnabled(isOnChangeRecorded());
 
   sg->tableItem = new QTableWidgetItem(pvName);
   signalsE.append(sg);
@@ -339,13 +978,17 @@ void QChartMX::addSignal(const QString & pvName) {
   ui->dataTable->setHorizontalHeaderItem(tablePos, sg->tableItem);
 
   sg->sig->setStyleSheet("color: " + sigcolor.name() + ";");
+  ui->splitter_2->addWidget(sg->waterfallPlot);
 
   constructSignalsLayout();
 
   preparePlot();
+  sg->envelope->attach(ui->plot);
+  sg->historyCurve->attach(ui->plot);
   sg->curve->attach(ui->plot);
   ui->plot->replot();
 
+  applyTrigger();
   emit configurationChanged();
 
 }
@@ -373,6 +1016,8 @@ void QChartMX::removeSignal(const QString & pvName) {
   signalsE.removeOne(sg);
   delete sg;
   constructSignalsLayout();
+  applyStorage();
+  applyTrigger();
 
   ui->plot->replot();
 
@@ -380,80 +1025,563 @@ void QChartMX::removeSignal(const QString & pvName) {
 
 }
 
+// The .dat file is a copy of the recording; the other formats are written
+// from the sample buffers. Both run in the background.
 void QChartMX::saveResult(const QString & resFile) {
-  if (tableWasSavedTo.isEmpty())
+  if ( tableWasSavedTo.isEmpty() || exporter->isRunning() )
     return;
   QString dataName = resFile.isEmpty() ?
-        QFileDialog::getSaveFileName(this, "Save data", saveDir() ) :
+        QFileDialog::getSaveFileName(this, "Save data", saveDir(), Exporter::filters() ) :
         resFile ;
-  if (QFile::exists(dataName))
-    QFile::remove(dataName);
-  QFile::copy(tableWasSavedTo, dataName);
+  if (dataName.isEmpty())
+    return;
+  if ( Exporter::format(dataName) == Exporter::Dat ) {
+    dataStr.flush();
+    exporter->copyFile(tableWasSavedTo, dataName);
+  } else {
+    exportBuffers(dataName);
+  }
+  ui->exportProgress->setValue(0);
+  ui->exportProgress->setVisible(true);
+  ui->cancelExport->setVisible(true);
 }
 
-void QChartMX::setControlCollapsed(bool val) {
-  ui->control->setVisible(!val);
+
+// Samples of the window, oldest first, with the time of every sample.
+// Decoding the buffers is the only part done here; formatting and writing
+// happen on the exporter's thread.
+void QChartMX::exportBuffers(const QString & fileName) {
+
+  const int rows = timeAxis.count();
+  QVector<qint64> stamps(rows);
+  for (int row = 0 ; row < rows ; row++)
+    stamps[row] = timeAxis.time(rows - 1 - row);
+
+  QList<ExportColumn> columns;
+  QStringList header;
+  header
+      << "# Time Scan"
+      << "#"
+      << "# Exported from memory: " + QString::number(rows) + " points"
+      << "# Interval (sec): " + QString::number(interval())
+      << "#"
+      << "# Data columns:";
+  QString names = "# %Point %Time ";
+  foreach (Signal * sig, signalsE) {
+    ExportColumn col;
+    col.name = sig->pv();
+    col.values.resize(rows);
+    for (int row = 0 ; row < rows ; row++)
+      col.values[row] = sig->sampleAt(rows - 1 - row);
+    columns << col;
+    names += "%" + QString(sig->pv()).remove(' ') + " ";
+  }
+  header << names;
+
+  exporter->exportData(fileName, header, point - rows + 1, stamps, columns);
+
 }
 
-void QChartMX::setGridVisible(bool show){
-  if ( sender() != ui->showGrid ) {
-    ui->showGrid->setChecked(show);
+
+void QChartMX::applyPublish() {
+  if ( publishAddress() == publisher->address() && publisher->isListening() )
     return;
+  if ( publishAddress().isEmpty() ) {
+    publisher->close();
+    ui->publish->setStyleSheet(goodStyle);
+  } else {
+    ui->publish->setStyleSheet( publisher->listen(publishAddress()) ? goodStyle : badStyle );
+    publisher->setSignals(allSignals());
   }
-  if (show)
-    grid->attach(ui->plot);
-  else
-    grid->detach();
-  ui->plot->replot();
   emit configurationChanged();
 }
 
-void QChartMX::setLogarithmic(bool val) {
-  ui->logY->setChecked(val);
+
+// Rows of the window, oldest first, for a subscriber which asked for them.
+void QChartMX::replayTo(int client) {
+  const int rows = timeAxis.count();
+  QVector<double> values(signalsE.size());
+  for (int age = rows - 1 ; age >= 0 ; age--) {
+    for (int icur = 0 ; icur < signalsE.size() ; icur++)
+      values[icur] = signalsE[icur]->sampleAt(age);
+    publisher->replayRow(client, timeAxis.time(age), values);
+  }
+  publisher->endReplay(client);
+}
+
+
+void QChartMX::applySharedMemory() {
+  if ( sharedMemory() == shm.name() && shm.isOpen() )
+    return;
+  openSharedMemory();
   emit configurationChanged();
 }
 
-void QChartMX::setNormalized(bool norm){
-  if ( sender() != ui->norma ) {
-    ui->norma->setChecked(norm);
+
+// (Re)creates the segment for the current signals and window and fills it
+// with the samples already taken.
+void QChartMX::openSharedMemory() {
+  if ( sharedMemory().isEmpty() ) {
+    shm.close();
+    ui->sharedMemory->setStyleSheet(goodStyle);
     return;
   }
-  foreach (Signal * sig, signalsE)
-    sig->setNormalized(norm);
-  ui->plot->enableAxis( QwtPlot::yLeft, ! norm );
-  setRanges();
+  const bool opened = shm.open(sharedMemory(), allSignals(), timeAxis.size());
+  ui->sharedMemory->setStyleSheet( opened ? goodStyle : badStyle );
+  QVector<double> values(signalsE.size());
+  for (int age = timeAxis.count() - 1 ; age >= 0 ; age--) {
+    for (int icur = 0 ; icur < signalsE.size() ; icur++)
+      values[icur] = signalsE[icur]->sampleAt(age);
+    shm.append(timeAxis.time(age), values);
+  }
 }
 
 
-void QChartMX::start() {
-  if ( ! isRunning() )
-    startStop();
+// Also on every change of the signal list: the trigger keeps the columns
+// of its inputs.
+bool QChartMX::applyTrigger() {
+  const bool ok = trigger.setup( Trigger::fromName(triggerMode()), triggerCondition(),
+                                 triggerLevel(), allSignals() );
+  triggerRow.resize(signalsE.size());
+  for (int icur = 0 ; icur < signalsE.size() ; icur++)
+    triggerRow[icur] = signalsE[icur]->samples().value(0);
+  ui->triggerCondition->setStyleSheet( ok ? goodStyle : badStyle );
+  ui->triggerCondition->setToolTip( ok  ?
+                                      "Signal or expression of the signals the trigger tests."  :
+                                      trigger.error() );
+  emit configurationChanged();
+  return ok;
 }
 
-void QChartMX::stop() {
-  if ( isRunning() )
-    startStop();
-}
 
-void QChartMX::lock(bool val) {
-  ui->startStop->setVisible(!val);
+void QChartMX::applySpectrum() {
+  Signal * sig = signal(spectrumSignal());
+  ui->spectrumSignal->setStyleSheet( sig || spectrumSignal().isEmpty() ? goodStyle : badStyle );
+  spectrumPlot->setVisible( ! spectrumSignal().isEmpty() );
+  if (sig)
+    spectrumCurve->setPen(sig->curve->pen());
+  spectrumCurve->setSamples(QVector<double>(), QVector<double>());
+  spectrumPlot->replot();
+  spectrumAge.invalidate(); // recompute with the new settings on the next tick
+  emit configurationChanged();
 }
 
 
+// The spectrum and the lag scan are recomputed at most every
+// analysisInterval and never while the previous computation runs, so a long
+// window costs the scan only the copy of the samples, whatever the rate of
+// the scan. The correlation matrix is shown at the same rate.
+static const int analysisInterval = 500; // ms
 
+// The spectrum is taken over the samples of the signal, at its own rate
+// when it is sampled every few ticks.
+void QChartMX::requestSpectrum() {
+  Signal * sig = signal(spectrumSignal());
+  if ( ! sig )
+    return;
+  const SampleAxis & axis = sig->sampleAxis();
+  const int count = axis.count();
+  if ( count < 4 || spectrum->isRunning() ||
+       ( spectrumAge.isValid() && spectrumAge.elapsed() < analysisInterval ) )
+    return;
+  const double duration = axis.seconds(0) - axis.seconds(count - 1);
+  if ( ! ( duration > 0.0 ) )
+    return;
+  QVector<double> samples(count);
+  for (int age = count - 1 ; age >= 0 ; age--)
+    samples[count - 1 - age] = sig->samples().value(age);
+  if ( spectrum->compute(samples, (count - 1) / duration,
+                         Spectrum::fromName(spectrumWindow()), spectrumAverages()) )
+    spectrumAge.start();
+}
 
-void QChartMX::browseAutoSave(){
-  QString new_dir = QFileDialog::getExistingDirectory(this, "Open directory", saveDir());
-  if ( ! new_dir.isEmpty() )
-    setSaveDir(new_dir);
+
+void QChartMX::showSpectrum() {
+  if ( ! spectrumPlot->isVisible() )
+    return;
+  spectrumCurve->setSamples(spectrum->frequencies(), spectrum->density());
+  spectrumPlot->replot();
 }
 
-void QChartMX::printResult(){
-  QPrinter printer;
-  QPrintDialog dialog(&printer);
-  if ( dialog.exec() ) {
-    QwtPlotRenderer renderer;
-    if ( printer.colorMode() == QPrinter::GrayScale ) {
+
+// Called once the axis has advanced to the newest row: the row pushed out
+// of the window, which was at leavingX, is replaced by the new one in
+// O(signals^2). As with the
+// statistics of the signals, the sums are rebuilt from the window once per
+// window length.
+void QChartMX::updateCorrelation(double leavingX) {
+
+  if ( ! isCorrelationShown() )
+    return;
+
+  const QStringList names = allSignals();
+  QVector<double> row(signalsE.size());
+  if ( names != correlationSignals || ++correlationUpdates >= timeAxis.size() ) {
+    correlation.reset(signalsE.size());
+    for (int age = timeAxis.count() - 1 ; age >= 0 ; age--) {
+      for (int icur = 0 ; icur < signalsE.size() ; icur++)
+        row[icur] = signalsE[icur]->sampleAt(age);
+      correlation.add(row.constData());
+    }
+    correlationUpdates = 0;
+  } else {
+    for (int icur = 0 ; icur < signalsE.size() ; icur++)
+      row[icur] = signalsE[icur]->leavingValue(leavingX);
+    correlation.remove(row.constData());
+    correlation.add(rowValues.constData());
+  }
+
+  if ( names != correlationSignals ) {
+    correlationSignals = names;
+    correlationTable->clear();
+    correlationTable->setRowCount(names.size());
+    correlationTable->setColumnCount(names.size());
+    correlationTable->setHorizontalHeaderLabels(names);
+    correlationTable->setVerticalHeaderLabels(names);
+    for (int first = 0 ; first < names.size() ; first++)
+      for (int second = 0 ; second < names.size() ; second++)
+        correlationTable->setItem(first, second, new QTableWidgetItem);
+    correlationShown.invalidate();
+  }
+  if ( correlationShown.isValid() && correlationShown.elapsed() < analysisInterval )
+    return;
+  correlationShown.start();
+  for (int first = 0 ; first < names.size() ; first++)
+    for (int second = 0 ; second < names.size() ; second++)
+      correlationTable->item(first, second)->setText(
+            QString::number(correlation.r(first, second), 'f', 3) );
+
+}
+
+
+QStringList QChartMX::lagPair() const {
+  QStringList pair;
+  foreach (QString name, lagSignals().split(','))
+    pair << name.trimmed();
+  if ( pair.size() != 2 || ! signal(pair[0]) || ! signal(pair[1]) )
+    pair.clear();
+  return pair;
+}
+
+
+void QChartMX::applyLagScan() {
+  const bool ok = lagSignals().isEmpty() || ! lagPair().isEmpty();
+  ui->lagSignals->setStyleSheet( ok ? goodStyle : badStyle );
+  lagPlot->setVisible( ! lagSignals().isEmpty() );
+  lagPlot->setTitle(QString());
+  lagCurve->setSamples(QVector<double>(), QVector<double>());
+  lagPlot->replot();
+  lagAge.invalidate();
+  emit configurationChanged();
+}
+
+
+void QChartMX::requestLagScan() {
+  const int count = timeAxis.count();
+  if ( ! lagPlot->isVisible() || count < 4 || lagScan->isRunning() ||
+       ( lagAge.isValid() && lagAge.elapsed() < analysisInterval ) )
+    return;
+  const QStringList pair = lagPair();
+  const double duration = timeAxis.seconds(0) - timeAxis.seconds(count - 1);
+  if ( pair.isEmpty() || ! ( duration > 0.0 ) )
+    return;
+  // on the ticks of the chart: the ticks a signal was not sampled on count
+  // as its mean
+  const Signal * first = signal(pair[0]);
+  const Signal * second = signal(pair[1]);
+  QVector<double> firstValues(count), secondValues(count);
+  for (int age = count - 1 ; age >= 0 ; age--) {
+    firstValues[count - 1 - age] = first->sampleAt(age);
+    secondValues[count - 1 - age] = second->sampleAt(age);
+  }
+  if ( lagScan->scan(firstValues, secondValues, (count - 1) / duration) )
+    lagAge.start();
+}
+
+
+void QChartMX::showLagScan() {
+  const QStringList pair = lagPair();
+  if ( ! lagPlot->isVisible() || pair.isEmpty() )
+    return;
+  lagCurve->setSamples(lagScan->lags(), lagScan->coefficients());
+  lagPlot->setTitle( isnan(lagScan->bestLag())  ?  QString()  :
+                     QString("%1 follows %2 by %3 s (r = %4)")
+                     .arg(pair[1]).arg(pair[0])
+                     .arg(lagScan->bestLag(), 0, 'g', 4)
+                     .arg(lagScan->bestCoefficient(), 0, 'f', 3) );
+  lagPlot->replot();
+}
+
+
+// Every event goes to its own numbered file: the pre-trigger samples are
+// taken from the window, the post-trigger ones are added as they come.
+void QChartMX::startCapture() {
+
+  captureEvents++;
+  captureFile.setFileName( tableWasSavedTo + QString("_%1.dat").arg(captureEvents, 3, 10, QChar('0')) );
+  captureFile.open(QIODevice::Truncate | QIODevice::WriteOnly);
+  captureStr.setDevice(&captureFile);
+  captureStr.setRealNumberPrecision(17);
+
+  captureStr
+      << "# Time Scan event " << captureEvents << "\n"
+      << "#\n"
+      << "# Date: " << QDate::currentDate().toString() << "\n"
+      << "# Trigger: " << triggerMode() << " \"" << triggerCondition() << "\"";
+  if ( trigger.mode() != Trigger::NonZero )
+    captureStr << " level " << triggerLevel();
+  captureStr
+      << "\n"
+      << "#\n"
+      << "# Data columns:\n"
+      << "# %Point %Time ";
+  foreach (Signal * sig, signalsE)
+    captureStr << "%" << QString(sig->pv()).remove(' ') << " ";
+  captureStr << "\n";
+
+  for (int age = qMin(triggerPre(), timeAxis.count() - 1) ; age >= 0 ; age--)
+    writeCaptureRow(age);
+  captureLeft = triggerPost();
+  if ( ! captureLeft ) {
+    captureFile.close();
+    trigger.rearm();
+  }
+
+}
+
+
+void QChartMX::writeCaptureRow(int age) {
+  captureStr
+      << point + 1 - age << " "
+      << QDateTime::fromMSecsSinceEpoch(timeAxis.time(age)).toString("hh:mm:ss.zzz") << " ";
+  foreach (Signal * sig, signalsE) {
+    captureStr << sig->sampleAt(age) << " ";
+    sig->recordArray(point + 1 - age, sig->ownAge(age));
+  }
+  captureStr << "\n";
+}
+
+
+void QChartMX::exportFinished() {
+  ui->exportProgress->setVisible(false);
+  ui->cancelExport->setVisible(false);
+  if ( ! exporter->error().isEmpty() )
+    qDebug() << "Export to" << exporter->fileName() << "failed:" << exporter->error();
+  else if ( ! exporter->wasCancelled()  &&
+            ! qtiCommand.isEmpty()  &&  exporter->fileName() == tableWasSavedTo + "_qti.dat" )
+    QProcess::startDetached("qtiplot " + exporter->fileName());
+}
+
+void QChartMX::setControlCollapsed(bool val) {
+  ui->control->setVisible(!val);
+}
+
+void QChartMX::setPerformanceRecorded(bool val) {
+  ui->perfToFile->setChecked(val);
+}
+
+void QChartMX::setGridVisible(bool show){
+  if ( sender() != ui->showGrid ) {
+    ui->showGrid->setChecked(show);
+    return;
+  }
+  if (show)
+    grid->attach(ui->plot);
+  else
+    grid->detach();
+  ui->plot->replot();
+  emit configurationChanged();
+}
+
+void QChartMX::setLogarithmic(bool val) {
+  ui->logY->setChecked(val);
+  emit configurationChanged();
+}
+
+void QChartMX::setNormalized(bool norm){
+  if ( sender() != ui->norma ) {
+    ui->norma->setChecked(norm);
+    return;
+  }
+  foreach (Signal * sig, signalsE)
+    sig->setNormalized(norm);
+  ui->plot->enableAxis( QwtPlot::yLeft, ! norm );
+  setRanges();
+}
+
+
+void QChartMX::start() {
+  if ( ! isRunning() && ! barrier->isWaiting() )
+    startStop();
+}
+
+void QChartMX::stop() {
+  if ( isRunning() || barrier->isWaiting() )
+    startStop();
+}
+
+// The plot and the table hold what they showed, while the scan goes on
+// filling the live buffers and the file. Freezing shares the storage of the
+// buffers (copied only when the scan next writes to them) and resuming just
+// points the curves back to the live buffers; the table gets the rows taken
+// in between.
+void QChartMX::setFrozen(bool val) {
+  if ( sender() != ui->freeze ) {
+    ui->freeze->setChecked(val);
+    return;
+  }
+  if (val)
+    frozenAxis = timeAxis;
+  foreach(Signal * sig, signalsE)
+    sig->freeze(val);
+  zoomer->setEnabled(val);
+  panner->setEnabled(val);
+  if (val) {
+    zoomer->setZoomBase();
+    return;
+  }
+  frozenAxis = SampleAxis();
+  foreach(Signal * sig, signalsE)
+    sig->historyCurve->setSamples(QVector<QPointF>());
+  foreach(QStringList row, heldRows) {
+    const int pointNumber = row.takeFirst().toInt();
+    const QString time = row.takeFirst();
+    addTableRow(pointNumber, time, row);
+  }
+  heldRows.clear();
+  updateTimeScale(true);
+  updateRanges(true);
+  ui->plot->replot();
+}
+
+// Rows which have left the window are read back from the data file when the
+// frozen plot is zoomed or panned before it. Up to historyChunks chunks are
+// paged in (through the LRU cache of the history); a longer span is drawn
+// from the ranges kept in the chunk index alone, at two points per chunk.
+static const int historyChunks = 32;
+
+void QChartMX::loadHistory() {
+
+  if ( ! isFrozen() || isNormalized() || ! frozenAxis.count() ||
+       ! history.open(tableWasSavedTo) || history.signalNames().size() != signalsE.size() )
+    return;
+
+  #if QWT_VERSION >= 0x060100
+  const QwtScaleDiv & xDiv = ui->plot->axisScaleDiv(QwtPlot::xBottom);
+  #else
+  const QwtScaleDiv & xDiv = * ui->plot->axisScaleDiv(QwtPlot::xBottom);
+  #endif
+  const double x0 = xDiv.lowerBound();
+  const double x1 = qMin(xDiv.upperBound(), frozenAxis.x(frozenAxis.count() - 1));
+  const QList<int> chunks = x0 < x1  ?  history.chunksIn(x0, x1)  :  QList<int>() ;
+  const bool overview = chunks.size() > historyChunks;
+
+  QVector< QVector<QPointF> > points(signalsE.size());
+  foreach (int idx, chunks) {
+    if (overview) {
+      const HistoryChunk & chk = history.chunk(idx);
+      const double mid = ( chk.firstX + chk.lastX ) / 2;
+      for (int sig = 0 ; sig < signalsE.size() ; sig++)
+        if ( ! isnan(chk.mins[sig]) )
+          points[sig] << QPointF(mid, chk.mins[sig]) << QPointF(mid, chk.maxs[sig]);
+      continue;
+    }
+    const HistoryRows * rows = history.rows(idx);
+    if ( ! rows )
+      continue;
+    const int signalsCount = signalsE.size();
+    for (int row = 0 ; row < rows->x.size() ; row++) {
+      const double xx = rows->x[row];
+      if ( xx < x0 || xx >= x1 )
+        continue;
+      for (int sig = 0 ; sig < signalsCount ; sig++) {
+        const double val = rows->values[row * signalsCount + sig];
+        if ( ! isnan(val) )
+          points[sig] << QPointF(xx, val);
+      }
+    }
+  }
+
+  for (int sig = 0 ; sig < signalsE.size() ; sig++)
+    signalsE[sig]->historyCurve->setSamples(points[sig]);
+  ui->plot->replot();
+
+}
+
+void QChartMX::lock(bool val) {
+  ui->startStop->setVisible(!val);
+}
+
+
+
+
+void QChartMX::browseAutoSave(){
+  QString new_dir = QFileDialog::getExistingDirectory(this, "Open directory", saveDir());
+  if ( ! new_dir.isEmpty() )
+    setSaveDir(new_dir);
+}
+
+// The plots shown are rendered to fileName and, next to it, to
+// <name>_spectrum, <name>_lag and <name>_<signal> for the waterfalls, all
+// in the format of its suffix. Only the recording of the plots happens
+// here: false if the previous batch is still being rendered.
+bool QChartMX::renderPlots(const QString & fileName, const QSize & size) {
+
+  if ( renderer->isRunning() || ! SnapshotRenderer::isSupported(fileName) )
+    return false;
+
+  const QFileInfo info(fileName);
+  const QString base = info.path() + "/" + info.completeBaseName() + "_";
+  const QString ext = "." + info.suffix();
+  QList<PlotSnapshot> batch;
+  batch << SnapshotRenderer::snapshot(ui->plot, fileName, size);
+  if ( ! spectrumSignal().isEmpty() )
+    batch << SnapshotRenderer::snapshot(spectrumPlot, base + "spectrum" + ext, size);
+  if ( ! lagSignals().isEmpty() )
+    batch << SnapshotRenderer::snapshot(lagPlot, base + "lag" + ext, size);
+  foreach(Signal * sig, signalsE)
+    if ( sig->isArray() )
+      batch << SnapshotRenderer::snapshot(sig->waterfallPlot,
+                 base + QString(sig->pv()).replace(QRegExp("\\W"), "_") + ext, size);
+  return renderer->render(batch);
+
+}
+
+void QChartMX::applyRender() {
+  if ( isRunning() && renderInterval() > 0.0 )
+    renderTimer->start( (int) ( 1000 * renderInterval() ) );
+  else
+    renderTimer->stop();
+  emit configurationChanged();
+}
+
+// Snapshots are named after the data file and the time they are taken. A
+// snapshot due while the previous one is still being rendered is skipped
+// rather than queued, so that a slow disk never holds the acquisition.
+void QChartMX::autoRender() {
+  const QString name = saveDir() + QFileInfo(tableWasSavedTo).completeBaseName() + "_" +
+      QDateTime::currentDateTime().toString("yyyy-MM-dd_hh-mm-ss") + "." + renderFormat();
+  if ( ! renderPlots(name) )
+    setRenderProblem("Snapshot " + name + " skipped: the previous one was still being rendered.");
+}
+
+void QChartMX::renderFinished() {
+  setRenderProblem( renderer->errors().join("\n") );
+}
+
+// The render controls turn red with the problem in their tool tip, until
+// the next batch of snapshots is written.
+void QChartMX::setRenderProblem(const QString & problem) {
+  ui->renderWidget->setStyleSheet( problem.isEmpty()  ?  goodStyle  :  badStyle );
+  ui->renderWidget->setToolTip(problem);
+}
+
+void QChartMX::printResult(){
+  QPrinter printer;
+  QPrintDialog dialog(&printer);
+  if ( dialog.exec() ) {
+    QwtPlotRenderer renderer;
+    if ( printer.colorMode() == QPrinter::GrayScale ) {
       renderer.setDiscardFlag(QwtPlotRenderer::DiscardCanvasBackground);
       renderer.setLayoutFlag(QwtPlotRenderer::FrameWithScales);
     }
@@ -471,10 +1599,20 @@ void QChartMX::constructSignalsLayout(){
     ui->signalsL->addWidget(sg->rem,   position, 0);
     ui->signalsL->addWidget(sg->sig,    position, 1);
     ui->signalsL->addWidget(sg->val,   position, 2);
+    ui->signalsL->addWidget(sg->everyBox, position, 3);
+    ui->signalsL->addWidget(sg->deadbandEdit, position, 4);
+    ui->signalsL->addWidget(sg->statsLabel, position, 5);
   }
   ui->addSignal->setStyleSheet( signalsE.size() ? goodStyle : badStyle );
 }
 
+QChartMX::Signal * QChartMX::signal(const QString & pvName) const {
+  foreach(Signal * sig, signalsE)
+    if (sig->pv() == pvName)
+      return sig;
+  return 0;
+}
+
 int QChartMX::column(Signal * sig) const {
   for (int icur = 0 ; icur < ui->dataTable->columnCount() ; icur++ )
     if ( ui->dataTable->horizontalHeaderItem(icur)  == sig->tableItem )
@@ -483,31 +1621,14 @@ int QChartMX::column(Signal * sig) const {
 }
 
 
+// QtiPlot is started once the file is written: see exportFinished().
 void QChartMX::openQti() {
-  if (qtiCommand.isEmpty())
+  if ( qtiCommand.isEmpty() || exporter->isRunning() )
     return;
-
-  QString dataN = tableWasSavedTo + "_qti.dat";
-  QFile dataFile(dataN);
-  dataFile.open(QIODevice::Truncate | QIODevice::WriteOnly);
-  QTextStream dataStr(&dataFile);
-
-  dataStr << "X ";
-  foreach (Signal * sig, signalsE)
-    dataStr
-        << sig->pv() << " ";
-  dataStr << "\n";
-
-  for ( int y = 0 ; y < ui->dataTable->rowCount(); y++ ) {
-    for ( int x = 0 ; x < ui->dataTable->columnCount() ; x++ )
-      dataStr << ( ui->dataTable->item(y,x) ?
-                   ui->dataTable->item(y,x)->text() : "NaN") << " ";
-    dataStr << "\n";
-  }
-  dataFile.close();
-
-  QProcess::startDetached("qtiplot " + dataN);
-
+  exportBuffers(tableWasSavedTo + "_qti.dat");
+  ui->exportProgress->setValue(0);
+  ui->exportProgress->setVisible(true);
+  ui->cancelExport->setVisible(true);
 }
 
 
@@ -527,6 +1648,42 @@ void QChartMX::logScale() {
 }
 
 void QChartMX::setRanges() {
+  updateRanges(true);
+  ui->plot->replot();
+  emit configurationChanged();
+}
+
+
+// Automatic bounds get some headroom and are rounded to a nice step (to
+// whole decades on the logarithmic axis), so that the axis does not follow
+// every new extreme of the data. They grow as soon as the data leave them,
+// but shrink only once the new bounds would span less than half of the
+// axis, or after they have been narrower for shrinkDelay. The axis is then
+// laid out again a few times per minute rather than on every sample.
+static const double headroom = 0.05;
+static const int shrinkDelay = 10000; // ms
+
+static void niceBounds(double & lo, double & hi, bool logarithmic) {
+  if ( logarithmic && lo > 0.0 ) {
+    lo = pow(10.0, floor(log10(lo)));
+    hi = pow(10.0, ceil(log10(hi)));
+    if ( lo == hi )
+      hi *= 10.0;
+    return;
+  }
+  const double range = hi - lo;
+  lo -= headroom * range;
+  hi += headroom * range;
+  const double rough = (hi - lo) / 5;
+  const double magnitude = pow(10.0, floor(log10(rough)));
+  const double norm = rough / magnitude;
+  const double step = magnitude * ( norm <= 1.0 ? 1.0 : norm <= 2.0 ? 2.0 : norm <= 5.0 ? 5.0 : 10.0 );
+  lo = floor(lo / step) * step;
+  hi = ceil(hi / step) * step;
+}
+
+
+bool QChartMX::updateRanges(bool force) {
 
   double m=dataMin(), M=dataMax();
 
@@ -546,27 +1703,45 @@ void QChartMX::setRanges() {
     M = (M==0.0 ?  0.1 : M*1.1);
   }
 
-  if ( ! isAutoMin() )
-    m = min();
-  else
-    ui->min->setValue(m);
-  if ( ! isAutoMax() )
-    M = max();
-  else
-    ui->max->setValue(M);
-
   #if QWT_VERSION >= 0x060100
-  if ( m != ui->plot->axisScaleDiv(QwtPlot::yLeft).lowerBound() ||
-       M != ui->plot->axisScaleDiv(QwtPlot::yLeft).upperBound() )
+  const double lo = ui->plot->axisScaleDiv(QwtPlot::yLeft).lowerBound();
+  const double hi = ui->plot->axisScaleDiv(QwtPlot::yLeft).upperBound();
   #else
-  if ( m != ui->plot->axisScaleDiv(QwtPlot::yLeft)->lowerBound() ||
-       M != ui->plot->axisScaleDiv(QwtPlot::yLeft)->upperBound() )
+  const double lo = ui->plot->axisScaleDiv(QwtPlot::yLeft)->lowerBound();
+  const double hi = ui->plot->axisScaleDiv(QwtPlot::yLeft)->upperBound();
   #endif
-    ui->plot->setAxisScale(QwtPlot::yLeft, m, M);
 
-  ui->plot->replot();
+  const bool noData = isnan(m) || isnan(M);
+  const bool outside = ! noData &&
+      ( ( isAutoMin() && m < lo ) || ( isAutoMax() && M > hi ) );
+  if ( ! noData && ! isNormalized() )
+    niceBounds(m, M, isLogarithmic());
+  if ( noData || ! isAutoMin() )
+    m = isAutoMin() ? lo : min();
+  if ( noData || ! isAutoMax() )
+    M = isAutoMax() ? hi : max();
+  if ( m == lo && M == hi ) {
+    shrinkSince.invalidate();
+    return false;
+  }
 
-  emit configurationChanged();
+  const bool manual = ( ! isAutoMin() && m != lo ) || ( ! isAutoMax() && M != hi );
+  if ( ! force && ! outside && ! manual ) {
+    const bool halved = isLogarithmic()  ?
+          log(M/m) < 0.5 * log(hi/lo)  :  M - m < 0.5 * (hi - lo) ;
+    if ( ! shrinkSince.isValid() )
+      shrinkSince.start();
+    if ( ! halved && shrinkSince.elapsed() < shrinkDelay )
+      return false;
+  }
+  shrinkSince.invalidate();
+
+  if ( isAutoMin() )
+    ui->min->setValue(m);
+  if ( isAutoMax() )
+    ui->max->setValue(M);
+  ui->plot->setAxisScale(QwtPlot::yLeft, m, M);
+  return true;
 
 }
 
@@ -591,79 +1766,251 @@ double QChartMX::dataMax() {
 
 void QChartMX::startStop(){
 
+  if ( barrier->isWaiting() ) {
+    barrier->cancel();
+    ui->startStop->setText("Start");
+    ui->control->setEnabled(true);
+    return;
+  }
+
   if ( isRunning() ) {
 
     timer->stop();
+    groupRead.cancel(); // the row in flight is not recorded
+    renderTimer->stop();
+    if ( renderInterval() > 0.0 )
+      autoRender(); // the final state
+    setFrozen(false);
+    ui->freeze->setEnabled(false);
     ui->startStop->setText("Start");
     ui->control->setEnabled(true);
-    if (dataFile.isOpen())
+    showPerformance(true);
+    foreach (Signal * sig, signalsE)
+      sig->setArrayFile();
+    if (captureFile.isOpen()) {
+      captureStr.flush();
+      captureFile.close();
+    }
+    if (dataFile.isOpen()) {
+      if (isPerformanceRecorded())
+        dataStr
+            << "#\n"
+            << "# Performance:\n"
+            << perf.report("# ")
+            << "# Kernels: " << lineKernelsIsa() << "\n";
+      dataStr.flush();
+      historyIndex.close(dataFile.pos());
       dataFile.close();
+    }
 
   } else {
 
-    preparePlot();
-    point = 0;
-    ui->startStop->setText("Stop");
-    ui->control->setEnabled(false);
-
-    // Data file
-    if (isAutoName())
-      setAutoName(true); // to update the filename
-    tableWasSavedTo = saveDir() + saveName();
-    dataFile.setFileName(tableWasSavedTo);
-    dataFile.open(QIODevice::Truncate | QIODevice::WriteOnly);
-    dataStr.setDevice(&dataFile);
-
-    // buttons
-    ui->saveResult->setEnabled(true);
-    ui->printResult->setEnabled(true);
-    ui->qtiResults->setEnabled(true);
-    ui->norma->setEnabled(true);
-
-    ui->dataTable->setRowCount(0);
+    // The channels are opened as soon as the signals are set: wait for the
+    // ones still connecting, at most connectTimeout(), so that the first
+    // rows are not lost to them. Start again to give up waiting.
+    if ( isSnapshotRead() )
+      groupRead.setPVs(caSignals()); // its channels connect meanwhile
+    if ( connectTimeout() > 0.0 &&
+         barrier->wait(channels(), (int) ( 1000 * connectTimeout() )) ) {
+      ui->startStop->setText("Connecting...");
+      ui->control->setEnabled(false);
+      return; // startScan() once they are
+    }
+    startScan();
+
+  }
+
+}
 
+
+QList<QEpicsPv*> QChartMX::channels() const {
+  QList<QEpicsPv*> pvs;
+  foreach (Signal * sig, signalsE)
+    pvs << sig->channels();
+  return pvs;
+}
+
+
+void QChartMX::startScan() {
+
+  preparePlot();
+  point = 0;
+  ui->startStop->setText("Stop");
+  ui->control->setEnabled(false);
+
+  // Data file
+  if (isAutoName())
+    setAutoName(true); // to update the filename
+  tableWasSavedTo = saveDir() + saveName();
+  dataFile.setFileName(tableWasSavedTo);
+  dataFile.open(QIODevice::Truncate | QIODevice::WriteOnly);
+  dataStr.setDevice(&dataFile);
+
+  // buttons
+  ui->saveResult->setEnabled(true);
+  ui->printResult->setEnabled(true);
+  ui->qtiResults->setEnabled(true);
+  ui->freeze->setEnabled(true);
+  ui->norma->setEnabled(true);
+
+  ui->dataTable->setRowCount(0);
+
+  dataStr
+      << "# Time Scan\n"
+      << "#\n"
+      << "# Date: " << QDate::currentDate().toString() << "\n"
+      << "# Time: " << QTime::currentTime().toString() << "\n"
+      << "#\n";
+
+  dataStr
+      << "# Number of scan points: " << ( isContinious() ?
+                                            "continious scan" :
+                                            QString::number(timeAxis.size()) ) << "\n"
+      << "# Interval (sec): " << interval() << "\n"
+      << "# Read mode: " << ( isSnapshotRead() ? "snapshot" : "monitor" ) << "\n";
+
+  dataStr
+      << "# Signals:\n"
+      << "#\n";
+  bool anySparse = false;
+  bool anyDeadband = false;
+  foreach (Signal * sig, signalsE) {
     dataStr
-        << "# Time Scan\n"
-        << "#\n"
-        << "# Date: " << QDate::currentDate().toString() << "\n"
-        << "# Time: " << QTime::currentTime().toString() << "\n"
+        << "# PV: \"" << sig->pv() << "\"";
+    if ( sig->sampledEvery() > 1 )
+      dataStr
+          << " sampled every " << sig->sampledEvery() << " intervals";
+    const bool deadband = isOnChangeRecorded() &&
+                          ! sig->deadband().isEmpty() && sig->isDeadbandValid();
+    if (deadband)
+      dataStr
+          << " deadband " << sig->deadband();
+    dataStr << "\n";
+    anySparse |= sig->sampledEvery() > 1;
+    anyDeadband |= deadband;
+    sig->forgetRecorded();
+  }
+  dataStr << "#\n";
+  // time from opening the channel to its connection, -1 if not connected
+  QStringList connectTimes;
+  foreach (QEpicsPv * pv, channels())
+    connectTimes << PvPool::name(pv) + " " + QString::number(PvPool::connectTime(pv));
+  dataStr
+      << "# Connected in (ms): " << connectTimes.join(", ") << "\n"
+      << "#\n";
+  if (anySparse)
+    dataStr
+        << "# The columns of a signal hold \"-\" at the points it was not sampled at;\n"
+        << "# without a script the points where no signal was sampled are left out.\n"
         << "#\n";
-
+  if (anyDeadband)
     dataStr
-        << "# Number of scan points: " << ( isContinious() ?
-                                              "continious scan" :
-                                              QString::number(timeData.size()) )
-        << "# Interval (sec): " << interval();
+        << "# The columns of a signal hold \"=\" where it stayed within its deadband:\n"
+        << "# the value recorded last still holds. Without a script the points where\n"
+        << "# nothing changed are left out. Every " << HistoryIndex::chunkRows
+        << " recorded rows the signals start\n"
+        << "# over with their full values.\n"
+        << "#\n";
 
+  bool anyArray = false;
+  foreach (Signal * sig, signalsE) {
+    sig->setArrayFile( tableWasSavedTo + "_" + QString::number(column(sig)) + ".bin" );
+    anyArray |= sig->isArray();
+  }
+  if (anyArray)
     dataStr
-        << "# Signals:\n"
+        << "# Array PVs: the data column holds the mean of the elements; all elements\n"
+        << "# are in <data file>_<column>.bin, one record per recorded point (with\n"
+        << "# the trigger: per captured point): int32 point, int32 count followed by\n"
+        << "# count float64, native byte order.\n"
         << "#\n";
-    foreach (Signal * sig, signalsE)
-      dataStr
-          << "# PV: \"" << sig->pv() << "\"\n";
-    dataStr << "#\n";
 
-    if ( ! ui->script->path().isEmpty() )
-      dataStr
-          << "# Script string: \"" << ui->script->path() << "\"\n\n";
+  if ( ! ui->script->path().isEmpty() )
+    dataStr
+        << "# Script string: \"" << ui->script->path() << "\"\n\n";
 
+  applyTrigger();
+  captureLeft = 0;
+  captureEvents = 0;
+  if ( trigger.mode() != Trigger::Off )
     dataStr
-        << "# Data columns:\n"
-        << "# "
-        << "%Point "
-        << "%Time ";
-    foreach (Signal * sig, signalsE)
-      dataStr
-          << "%" << sig->pv() << " ";
-    if ( ! ui->script->path().isEmpty() )
+        << "# Triggered capture: " << triggerMode() << " \"" << triggerCondition() << "\"\n"
+        << "# The rows around every event are in <data file>_<event>.dat,\n"
+        << "# " << triggerPre() << " samples before and " << triggerPost() << " after it.\n"
+        << "#\n";
+
+  dataStr
+      << "# Data columns:\n"
+      << "# "
+      << "%Point "
+      << "%Time ";
+  foreach (Signal * sig, signalsE) {
+    // expressions of the derived signals may have spaces
+    const QString name = QString(sig->pv()).remove(' ');
+    dataStr
+        << "%" << name << " ";
+    if ( isAggregateRecorded() )
       dataStr
-          << "%Script";
-    dataStr << "\n";
+          << "%" << name << ":min "
+          << "%" << name << ":max "
+          << "%" << name << ":std "
+          << "%" << name << ":count ";
+  }
+  if ( ! ui->script->path().isEmpty() )
+    dataStr
+        << "%Script";
+  dataStr << "\n";
+  dataStr.flush();
+  if ( trigger.mode() == Trigger::Off )
+    historyIndex.open(tableWasSavedTo, allSignals(),
+                      isAggregateRecorded() && isAggregated() ? 5 : 1,
+                      isRealTime(), dataFile.pos());
+  history.close();
+
+  if ( isSnapshotRead() )
+    groupRead.setPVs(caSignals());
+  perf.reset(interval());
+  requestData();
+  timer->start( (int)(1000*interval()) );
+  if ( renderInterval() > 0.0 )
+    renderTimer->start( (int) ( 1000 * renderInterval() ) );
 
-    getData();
-    timer->start( (int)(1000*interval()) );
+}
+
+
+// Precision of the sample buffers: the fixed one, or with "auto" the most
+// precise one which keeps all buffers of the window within the budget.
+void QChartMX::applyStorage() {
+
+  const qint64 points = (qint64) ( period() / interval() );
+  const qint64 stamps = isRealTime()  ?  points * sizeof(qint64)  :  0 ;
+  bool fixed;
+  SampleBuffer::Precision prec = SampleBuffer::fromName(storage(), &fixed);
+  if ( ! fixed ) {
+    const qint64 budget = (qint64) ( memoryBudget() * 1024 * 1024 ) - stamps;
+    qint64 samples = 0;
+    foreach (Signal * sig, signalsE)
+      samples += (qint64) sig->buffers() * sparsePoints(points, sig->sampledEvery());
+    const SampleBuffer::Precision order[] =
+        {SampleBuffer::Float64, SampleBuffer::Float32, SampleBuffer::Int16};
+    prec = SampleBuffer::Int16;
+    for (int idx = 0 ; idx < 3 ; idx++)
+      if ( samples * SampleBuffer::bytes(order[idx]) <= budget ) {
+        prec = order[idx];
+        break;
+      }
+  }
 
+  qint64 used = stamps;
+  foreach (Signal * sig, signalsE) {
+    sig->setPrecision( sig->forcedPrecision < 0  ?
+                         prec  :  (SampleBuffer::Precision) sig->forcedPrecision );
+    used += (qint64) sig->buffers() * sparsePoints(points, sig->sampledEvery())
+            * SampleBuffer::bytes(sig->precision());
   }
+  ui->storage->setToolTip( QString("Samples stored as %1, %2 MB in use.")
+                           .arg(SampleBuffer::name(prec))
+                           .arg(used / (1024.0*1024.0), 0, 'f', 1) );
 
 }
 
@@ -672,75 +2019,282 @@ void QChartMX::preparePlot() {
 
   int points = (int) (period() / interval());
 
-  ui->plot->setAxisScaleDraw(QwtPlot::xBottom,
-                             new TimeScaleDraw(QTime::currentTime().addMSecs((int)(-period()*1000)),
-                                               interval()));
-  ui->plot->setAxisScale(QwtPlot::xBottom, 0, points);
+  // the real time labels do not depend on the start: keep the scale draw
+  // and its label cache as long as the axis stays real time.
+  if ( isRealTime() ) {
+    if ( ! dynamic_cast<const RealTimeScaleDraw*>(ui->plot->axisScaleDraw(QwtPlot::xBottom)) ) {
+      ui->plot->setAxisScaleDraw(QwtPlot::xBottom, new RealTimeScaleDraw);
+      #if QWT_VERSION >= 0x060100
+      ui->plot->setAxisScaleEngine(QwtPlot::xBottom, new QwtDateScaleEngine);
+      #endif
+    }
+  } else {
+    ui->plot->setAxisScaleDraw(QwtPlot::xBottom,
+                               new TimeScaleDraw(QTime::currentTime().addMSecs((int)(-period()*1000)),
+                                                 interval()));
+    ui->plot->setAxisScaleEngine(QwtPlot::xBottom, new QwtLinearScaleEngine);
+  }
   ui->plot->setAxisLabelRotation(QwtPlot::xBottom, -50.0);
   ui->plot->setAxisLabelAlignment(QwtPlot::xBottom, Qt::AlignLeft | Qt::AlignBottom);
 
-  timeData.resize(points);
-  for ( int i = 0; i < points; i++ )
-      timeData(points - 1 - i) = i;
-
+  timeAxis.setTimestamped(isRealTime());
+  timeAxis.resize(points, QDateTime::currentMSecsSinceEpoch());
+  timeAxis.setSpan(period()*1000);
+  updateTimeScale(true);
+  applyStorage();
   foreach(Signal * sig, signalsE)
     sig->resetData();
+  if ( shm.isOpen() )
+    openSharedMemory();
+  spectrumCurve->setSamples(QVector<double>(), QVector<double>());
+  spectrumPlot->replot();
+  spectrumAge.invalidate();
+  correlationSignals.clear();
+  lagCurve->setSamples(QVector<double>(), QVector<double>());
+  lagPlot->replot();
+  lagAge.invalidate();
 
   ui->plot->replot();
 
 }
 
 
+// Either axis is moved in steps of 1/20 of the window, only when the
+// newest sample leaves it, so that the ticks are recalculated and the
+// labels laid out 20 times per window rather than on every point, and the
+// newest segments can be painted alone in between (replotNewest()).
+bool QChartMX::updateTimeScale(bool force) {
+
+  #if QWT_VERSION >= 0x060100
+  const double upper = ui->plot->axisScaleDiv(QwtPlot::xBottom).upperBound();
+  #else
+  const double upper = ui->plot->axisScaleDiv(QwtPlot::xBottom)->upperBound();
+  #endif
+  const double span = timeAxis.isTimestamped()  ?  period()*1000  :
+                      qMax(1.0, timeAxis.newest() - timeAxis.oldest()) ;
+  const double newest = timeAxis.newest();
+  if ( ! force && newest <= upper && newest > upper - span )
+    return false;
+  const double right = newest + span/20;
+  ui->plot->setAxisScale(QwtPlot::xBottom, right - span, right);
+  return true;
+
+}
+
+
+// While the axes stay put only the newest segment of every curve changes:
+// it is painted straight onto the canvas instead of redrawing the grid, the
+// axes and all the points. The samples leaving the window lie left of the
+// axis, which is a window wide, so the canvas stays correct until the axis
+// moves.
+void QChartMX::replotNewest(bool full) {
+  foreach(Signal * sig, signalsE)
+    full = full || sig->rescaled;
+  if (full) {
+    ui->plot->replot();
+    foreach(Signal * sig, signalsE)
+      sig->rescaled = false;
+  } else {
+    foreach(Signal * sig, signalsE)
+      sig->paintNewest(directPainter);
+  }
+}
+
+
+// With the snapshot read the tick only sends the grouped get: the row is
+// taken by getData() once the replies are in, and the GUI thread does not
+// wait for them.
+void QChartMX::requestData() {
+  if ( ! isSnapshotRead() ) {
+    getData();
+    return;
+  }
+  if ( groupRead.isPending() )
+    return; // the previous row is still awaited: this tick is skipped
+  if ( groupRead.pvs() != caSignals() )
+    groupRead.setPVs(caSignals());
+  if ( ! groupRead.request(interval()/2) )
+    getData(); // nothing to wait for
+}
+
+
 void QChartMX::getData() {
 
-  static bool gettingData=false;
   if (gettingData)
     return;
   gettingData = true;
 
-  const int points = timeData.size();
+  perf.beginTick();
 
-  QDateTime dt = QDateTime::currentDateTime();
-
-  int table_row = point;
-  if ( isContinious() && point > points-1 ) {
-    ui->dataTable->removeRow(0);
-    table_row=points-1;
-  }
-
-  ui->dataTable->insertRow(table_row);
-  ui->dataTable->setVerticalHeaderItem
-      (point, new QTableWidgetItem(QString::number(point+1)));
-  if ( ! ui->dataTable->underMouse() )
-  ui->dataTable->scrollToBottom();
-  ui->dataTable->setItem(table_row, 0,
-                         new QTableWidgetItem(dt.time().toString("hh:mm:ss.zzz")));
+  const int points = timeAxis.size();
 
-  dataStr << point+1 << " " << dt.toString("hh:mm:ss.zzz") << " ";
+  // with the snapshot read the row is from when the get was sent
+  QDateTime dt = isSnapshotRead()  ?  groupRead.requestTime()  :  QDateTime::currentDateTime() ;
 
-  timeData += 1;
-  ui->plot->setAxisScale(QwtPlot::xBottom,
-                         timeData(points-1), timeData(0));
+  // Every signal counts down the ticks to its next sample: the timer runs
+  // at the base interval and the signals sampled every few intervals are
+  // read on their ticks only. The value of a signal not sampled is empty.
+  QVector<bool> due(signalsE.size());
+  bool anyDue = false;
+  for (int icur = 0 ; icur < signalsE.size() ; icur++ ) {
+    due[icur] = signalsE[icur]->tick();
+    anyDue |= due[icur];
+  }
 
-  foreach(Signal * sig, signalsE) {
-    QString value = sig->get().toString();
-    QTableWidgetItem * item = new QTableWidgetItem(value);
-    item->setTextColor(sig->curve->pen().color());
-    ui->dataTable->setItem(table_row, column(sig), item);
-    dataStr << value << " ";
+  QStringList values;
+  if ( isSnapshotRead() ) {
+    // a signal added or removed while the get was in flight: no snapshot
+    const bool snapped = groupRead.pvs() == caSignals();
+    const QVector<double> snap = snapped  ?
+          groupRead.values()  :  QVector<double>(signalsE.size(), NAN) ;
+    // the derived signals take their inputs from the snapshot where these
+    // are scalar signals of the chart
+    QStringList snapNames;
+    if (snapped)
+      foreach (Signal * sig, signalsE)
+        snapNames << ( sig->isArray() || sig->isDerived()  ?  QString()  :  sig->pv() );
+    // arrays are not part of the grouped get: they take the monitored value.
+    for (int icur = 0 ; icur < signalsE.size() ; icur++ )
+      values << ( ! due[icur]  ?  QVariant()  :
+                  signalsE[icur]->isDerived()  ?  signalsE[icur]->get(snapNames, snap)  :
+                  signalsE[icur]->isArray()  ?  signalsE[icur]->get()  :
+                    signalsE[icur]->append(snap[icur]) ).toString();
+  } else {
+    for (int icur = 0 ; icur < signalsE.size() ; icur++ )
+      values << ( due[icur]  ?  signalsE[icur]->get()  :  QVariant() ).toString();
+  }
+  rowValues.resize(signalsE.size());
+  for (int icur = 0 ; icur < signalsE.size() ; icur++)
+    rowValues[icur] = due[icur]  ?  signalsE[icur]->samples().value(0)  :  NAN ;
+  perf.lap(PerfMonitor::PvRead);
+
+  if ( isFrozen() ) {
+    heldRows << ( QStringList() << QString::number(point)
+                  << dt.time().toString("hh:mm:ss.zzz") << values );
+    if ( heldRows.size() > points )
+      heldRows.removeFirst();
+  } else {
+    addTableRow(point, dt.time().toString("hh:mm:ss.zzz"), values);
+  }
+  perf.lap(PerfMonitor::Table);
+
+  // with the trigger only the events are recorded, in their own files;
+  // the columns of the signals not sampled hold "-", those of the signals
+  // which stay within their deadband hold "=", and the rows where nothing
+  // new is recorded are left out
+  // a new chunk of the history index starts from the full values, so
+  // that it can be read on its own
+  if ( historyIndex.isChunkStart() )
+    foreach (Signal * sig, signalsE)
+      sig->forgetRecorded();
+  QVector<bool> changed(signalsE.size());
+  bool anyChanged = false;
+  for (int icur = 0 ; icur < signalsE.size() ; icur++ ) {
+    changed[icur] = due[icur] &&
+        ! ( isOnChangeRecorded() && signalsE[icur]->withinDeadband(rowValues[icur]) );
+    anyChanged |= changed[icur];
   }
+  const bool recordRow = trigger.mode() == Trigger::Off &&
+                         ( anyChanged || ! ui->script->path().isEmpty() );
+  if (recordRow) {
+    dataStr << point+1 << " " << dt.toString("hh:mm:ss.zzz") << " ";
+    for (int icur = 0 ; icur < signalsE.size() ; icur++ ) {
+      if ( ! changed[icur] ) {
+        const char * mark = due[icur]  ?  "= "  :  "- " ;
+        dataStr << mark;
+        if ( isAggregateRecorded() && isAggregated() )
+          dataStr << mark << mark << mark << mark;
+        continue;
+      }
+      signalsE[icur]->noteRecorded(rowValues[icur]);
+      signalsE[icur]->recordArray(point+1);
+      dataStr << values[icur] << " ";
+      if ( isAggregateRecorded() )
+        dataStr << signalsE[icur]->aggregateColumns() << " ";
+    }
+    if ( ui->script->path().isEmpty() )
+      dataStr <<  "\n";
+  }
+  perf.lap(PerfMonitor::File);
+
   if ( ! ui->script->path().isEmpty() ) {
-    dataStr << ui->script->execute();
+    const QString scriptOut = ui->script->execute();
+    if (recordRow)
+      dataStr << scriptOut << "\n";
     qDebug() << "=== Script out (" << point+1 << "):\n" << ui->script->out();
     qDebug() << "=== Script err (" << point+1 << "):\n" << ui->script->err();
     qDebug() << "=== End script report (" << point+1 << ").";
+    perf.lap(PerfMonitor::Script);
   }
 
-  dataStr <<  "\n";
+  const double leavingX = timeAxis.count() == points  ?  timeAxis.x(points - 1)  :  NAN ;
+  timeAxis.advance(dt.toMSecsSinceEpoch());
+  if ( recordRow && historyIndex.add(point+1, timeAxis.x(0), rowValues) ) {
+    dataStr.flush();
+    historyIndex.closeChunk(dataFile.pos());
+  }
+  for (int icur = 0 ; icur < signalsE.size() ; icur++ )
+    if ( due[icur] ) {
+      signalsE[icur]->advance(dt.toMSecsSinceEpoch());
+      signalsE[icur]->updateStatistics();
+    }
+  updateCorrelation(leavingX);
+  perf.lap(PerfMonitor::Stats);
+
+  if ( publisher->isListening() )
+    publisher->setSignals(allSignals());
+  if ( shm.isOpen() && ( shm.pvs() != allSignals() || shm.capacity() != points ) ) {
+    openSharedMemory(); // new layout: the replay includes this row
+  } else if ( publisher->clients() || shm.isOpen() ) {
+    publisher->publish(dt.toMSecsSinceEpoch(), rowValues);
+    shm.append(dt.toMSecsSinceEpoch(), rowValues);
+  }
+  perf.lap(PerfMonitor::Publish);
+
+  if ( trigger.mode() != Trigger::Off ) {
+    if ( captureLeft ) {
+      writeCaptureRow(0);
+      if ( ! --captureLeft ) {
+        captureStr.flush();
+        captureFile.close();
+        trigger.rearm();
+      }
+    }
+    // the signals sampled every few ticks hold their newest sample in between
+    for (int icur = 0 ; icur < signalsE.size() ; icur++)
+      if ( due[icur] )
+        triggerRow[icur] = rowValues[icur];
+    if ( trigger.test(triggerRow.constData()) )
+      startCapture();
+    perf.lap(PerfMonitor::Trigger);
+  }
 
+  if ( ! isFrozen() ) {
+    const bool scrolled = updateTimeScale();
+    const bool rescaled = updateRanges();
+    if (rescaled)
+      emit configurationChanged();
+    perf.lap(PerfMonitor::Ranges);
 
-  setRanges();
-  ui->plot->replot();
+    replotNewest(scrolled || rescaled);
+    #if QWT_VERSION >= 0x060100
+    const QwtScaleDiv & xDiv = ui->plot->axisScaleDiv(QwtPlot::xBottom);
+    #else
+    const QwtScaleDiv & xDiv = * ui->plot->axisScaleDiv(QwtPlot::xBottom);
+    #endif
+    foreach(Signal * sig, signalsE)
+      sig->replotWaterfall(xDiv.lowerBound(), xDiv.upperBound());
+  }
+  perf.lap(PerfMonitor::Replot);
+  requestSpectrum();
+  requestLagScan();
+  perf.lap(PerfMonitor::Analysis);
+
+  perf.endTick();
+  perf.setQueueDepth("file", dataFile.bytesToWrite());
+  if ( publisher->isListening() )
+    perf.setQueueDepth("publish", publisher->queued());
+  showPerformance();
 
   if ( ! isContinious() && point >= points-1 )
     startStop();
@@ -751,6 +2305,43 @@ void QChartMX::getData() {
 }
 
 
+void QChartMX::addTableRow(int pointNumber, const QString & time, const QStringList & values) {
+
+  const int points = timeAxis.size();
+  int table_row = pointNumber;
+  if ( isContinious() && pointNumber > points-1 ) {
+    ui->dataTable->removeRow(0);
+    table_row=points-1;
+  }
+
+  ui->dataTable->insertRow(table_row);
+  ui->dataTable->setVerticalHeaderItem
+      (pointNumber, new QTableWidgetItem(QString::number(pointNumber+1)));
+  if ( ! ui->dataTable->underMouse() )
+  ui->dataTable->scrollToBottom();
+  ui->dataTable->setItem(table_row, 0, new QTableWidgetItem(time));
+
+  for (int icur = 0 ; icur < signalsE.size() ; icur++ ) {
+    Signal * sig = signalsE[icur];
+    QTableWidgetItem * item = new QTableWidgetItem(values[icur]);
+    item->setTextColor(sig->curve->pen().color());
+    ui->dataTable->setItem(table_row, column(sig), item);
+  }
+
+}
+
+
+void QChartMX::showPerformance(bool force) {
+  if ( ! ui->perfPanel->isChecked() )
+    return;
+  if ( ! force && perfShown.isValid() && perfShown.elapsed() < 500 )
+    return;
+  perfShown.start();
+  QString rep = perf.report() + "Kernels: " + lineKernelsIsa();
+  ui->perfReport->setText(rep);
+}
+
+
 
 
 
@@ -765,33 +2356,93 @@ QStringList QChartMX::Signal::knownDetectors = QStringList();
 QChartMX::Signal::Signal(QChartMX* parent) :
   QObject(parent),
   _min(NAN), _max(NAN),
-  _pv(new QEpicsPv(this)),
-  _desc(new QEpicsPv(this)),
-  xData( & parent->timeData ),
+  _pv(PvPool::acquire(QString())),
+  _desc(PvPool::acquire(QString())),
+  validCount(0),
+  chartAxis( & parent->timeAxis ),
+  axis(chartAxis),
+  ticksLeft(0),
+  frozen(false),
+  frozenCount(0),
+  frozenMin(NAN),
+  frozenMax(NAN),
+  frozenAxis( & parent->frozenAxis ),
   normalized(false),
   logscaled(false),
+  aggregated(false),
+  removedX(NAN),
+  removedV(NAN),
+  hasRecorded(false),
+  lastRecorded(NAN),
+  statsUpdates(0),
+  elements(0),
+  waterfallHead(0),
+  waterfallFilled(0),
+  waterfallWrites(0),
+  zMin(NAN),
+  zMax(NAN),
+  spectrogram(new WaterfallItem),
   rem(new QPushButton("-", parent)),
   sig(new QComboBox(parent)),
   val(new QLabel(parent)),
+  statsLabel(new QLabel(parent)),
+  everyBox(new QSpinBox(parent)),
+  deadbandEdit(new QLineEdit(parent)),
   tableItem(new QTableWidgetItem()),
-  curve(new QwtPlotCurve)
+  curve(new SignalCurve),
+  envelope(new QwtPlotIntervalCurve),
+  historyCurve(new QwtPlotCurve),
+  waterfallPlot(new QwtPlot(parent)),
+  forcedPrecision(-1),
+  rescaled(true)
 {
 
   sig->setEditable(true);
   sig->setDuplicatesEnabled(false);
   sig->addItems(knownDetectors);
   sig->clearEditText();
-  sig->setToolTip("PV of the signal.");
+  sig->setToolTip("PV of the signal, or \"=\" followed by an expression of PVs,"
+                  " e.g. \"=PV1 / PV2\"; names with other characters than"
+                  " letters, digits and _:. go in braces: \"={PV-1} * 1e3\".");
 
   rem->setToolTip("Remove the signal.");
   val->setToolTip("Current value.");
+  statsLabel->setToolTip("Over the window: mean ± standard deviation,"
+                         " [5th median 95th] percentiles and the slope per second.");
+  everyBox->setRange(1, 1000000);
+  everyBox->setPrefix("every ");
+  everyBox->setToolTip("Sample the signal on every n-th interval only: slow signals"
+                       " take less memory and leave their columns empty in between.");
+  deadbandEdit->setPlaceholderText("deadband");
+  deadbandEdit->setMaximumWidth(80);
+  deadbandEdit->setToolTip("With the recording on change, records the signal only when it changes:"
+                           " \"0\" on any change, \"x\" by more than x, \"x%\" by more"
+                           " than x% of the value recorded last. Empty to record every sample.");
 
   curve->setStyle(QwtPlotCurve::Lines);
   QwtSymbol * symbol = new QwtSymbol(QwtSymbol::Ellipse);
   symbol->setSize(9);
-  curve->setSymbol(symbol);
+  curve->setSymbol(cachedSymbol(symbol));
   curve->setPaintAttribute(QwtPlotCurve::ClipPolygons);
-  //curve->setPaintAttribute(QwtPlotCurve::CacheSymbols);
+  #if QWT_VERSION < 0x060100
+  curve->setPaintAttribute(QwtPlotCurve::CacheSymbols);
+  #endif
+  curve->setData(new SignalSeries(&data, axis, &validCount, &_min, &_max));
+
+  envelope->setData(new EnvelopeData(&lowData, &highData, axis, &validCount, &_min, &_max));
+  envelope->setStyle(QwtPlotIntervalCurve::Tube);
+  envelope->setPen(Qt::NoPen);
+  envelope->setItemAttribute(QwtPlotItem::Legend, false);
+  envelope->setVisible(false);
+  historyCurve->setItemAttribute(QwtPlotItem::Legend, false);
+
+  spectrogram->setColorMap(new QwtLinearColorMap(Qt::darkBlue, Qt::yellow));
+  spectrogram->setData(new WaterfallData(&waterfall, &waterfallHead, &waterfallFilled,
+                                           &waterfallWrites, axis));
+  spectrogram->attach(waterfallPlot);
+  waterfallPlot->setAutoReplot(false);
+  waterfallPlot->enableAxis(QwtPlot::xBottom, false);
+  waterfallPlot->setVisible(false);
 
 
   connect(sig, SIGNAL(editTextChanged(QString)), SLOT(setPV(QString)));
@@ -804,94 +2455,515 @@ QChartMX::Signal::Signal(QChartMX* parent) :
 
 
 QChartMX::Signal::~Signal(){
+  PvPool::release(_pv);
+  PvPool::release(_desc);
+  releaseInputs();
   curve->detach();
   delete curve;
+  envelope->detach();
+  delete envelope;
+  historyCurve->detach();
+  delete historyCurve;
+  setArrayFile();
+  spectrogram->detach();
+  delete spectrogram;
+  waterfallPlot->deleteLater();
   rem->deleteLater();
   sig->deleteLater();
   val->deleteLater();
+  statsLabel->deleteLater();
+  everyBox->deleteLater();
+  deadbandEdit->deleteLater();
+}
+
+
+void QChartMX::Signal::setPV(const QString & pvname) {
+
+  if ( pvname == _name )
+    return;
+
+  disconnect(_pv, 0, this, 0);
+  disconnect(_desc, 0, this, 0);
+  PvPool::release(_pv);
+  PvPool::release(_desc);
+  releaseInputs();
+  _name = pvname;
+  setElements(0); // until the value of the new PV tells otherwise
+
+  if ( isDerived() ) {
+    _pv = PvPool::acquire(QString());
+    _desc = PvPool::acquire(QString());
+    if ( expr.compile(pvname.mid(1)) ) {
+      foreach (QString input, expr.inputs()) {
+        QEpicsPv * ipv = PvPool::acquire(input);
+        connect(ipv, SIGNAL(connectionChanged(bool)), SLOT(updateInputs()));
+        inputs << ipv;
+      }
+      inputValues.fill(NAN, inputs.size());
+    }
+    setHeader();
+    updateInputs();
+    return;
+  }
+
+  // shared with other charts monitoring the same PV
+  _pv = PvPool::acquire(pvname);
+  _desc = PvPool::acquire( pvname.isEmpty() ? QString() : pvname+".DESC" );
+
+  connect(_pv, SIGNAL(pvChanged(QString)), SLOT(setHeader()));
+  connect(_desc, SIGNAL(valueChanged(QVariant)), SLOT(setHeader()));
+  connect(_pv, SIGNAL(valueUpdated(QVariant)), SLOT(updateValue(QVariant)));
+  connect(_pv, SIGNAL(connectionChanged(bool)), SLOT(setConnected(bool)));
+
+  setHeader();
+  if ( ! pvname.isEmpty() )
+    setConnected(_pv->isConnected());
+  if ( _pv->isConnected() ) // already monitored by another chart
+    setElements( _pv->get().type() == QVariant::List  ?  _pv->get().toList().size()  :  0 );
+
+}
+
+
+void QChartMX::Signal::releaseInputs() {
+  foreach (QEpicsPv * ipv, inputs) {
+    disconnect(ipv, 0, this, 0);
+    PvPool::release(ipv);
+  }
+  inputs.clear();
+}
+
+
+void QChartMX::Signal::updateInputs() {
+  if ( ! expr.isValid() ) {
+    rem->setStyleSheet("background-color: rgba(255, 0, 0,64);");
+    val->setText(expr.error());
+    return;
+  }
+  bool con = true;
+  foreach (QEpicsPv * ipv, inputs)
+    con &= ipv->isConnected();
+  setConnected(con);
+}
+
+
+QList<QEpicsPv*> QChartMX::Signal::channels() const {
+  if ( isDerived() )
+    return inputs;
+  QList<QEpicsPv*> pvs;
+  if ( ! _name.isEmpty() )
+    pvs << _pv;
+  return pvs;
 }
 
 
 QVariant QChartMX::Signal::get() {
+  if ( isDerived() )
+    return get(QStringList(), QVector<double>());
+  if ( ! _pv->isConnected() )
+    return isArray()  ?  appendArray(QVariantList())  :  append(NAN) ;
+  const QVariant & value = _pv->get();
+  if ( value.type() == QVariant::List )
+    return appendArray(value.toList());
+  return append(value.toDouble());
+}
+
+
+QVariant QChartMX::Signal::get(const QStringList & names, const QVector<double> & row) {
+  if ( ! isDerived() )
+    return get();
+  // inputs which are not connected (or not numbers) give NaN
+  const QStringList & inputNames = expr.inputs();
+  for (int idx = 0 ; idx < inputs.size() ; idx++) {
+    const int col = names.indexOf(inputNames[idx]);
+    inputValues[idx] = col >= 0  ?  row[col]  :
+                       inputs[idx]->isConnected()  ?  inputs[idx]->get().toDouble()  :  NAN ;
+  }
+  const QVariant result = append( expr.evaluate(inputValues.constData()) );
+  if ( expr.isValid() )
+    val->setText(result.toString());
+  return result;
+}
+
+
+QVariant QChartMX::Signal::appendArray(const QVariantList & list) {
+
+  const int points = axis->size();
+  if ( ! list.isEmpty() )
+    setElements(list.size());
+  if ( waterfall.extent(0) != points )
+    resetWaterfall();
+  if ( ! points || ! elements )
+    return append(NAN);
+
+  waterfallHead = (waterfallHead + 1) % points;
+  waterfallFilled = qMin(waterfallFilled + 1, points);
+  waterfallWrites++;
+  RunningStats rowStats;
+  for (int el = 0 ; el < elements ; el++) {
+    const double value = el < list.size()  ?  list[el].toDouble()  :  NAN ;
+    waterfall(waterfallHead, el) = value;
+    rowStats.add(value);
+  }
+  if ( rowStats.count() ) {
+    if ( isnan(zMin) || rowStats.min() < zMin )
+      zMin = rowStats.min();
+    if ( isnan(zMax) || rowStats.max() > zMax )
+      zMax = rowStats.max();
+  }
+
+  return append(rowStats.mean());
+
+}
+
+
+// The PV is an array if its value is: the waterfall follows its element
+// count and is freed when it turns out to be a scalar.
+void QChartMX::Signal::setElements(int count) {
+  if ( count == elements )
+    return;
+  elements = count;
+  resetWaterfall();
+}
+
+
+void QChartMX::Signal::resetWaterfall() {
+  const int points = elements ? axis->size() : 0;
+  waterfall.resize(points, elements);
+  waterfall = NAN;
+  waterfallHead = -1;
+  waterfallFilled = 0;
+  zMin = zMax = NAN;
+  waterfallPlot->setVisible(isArray());
+}
+
+
+// The WaterfallItem renders again only the columns of the new rows unless
+// the bounds have changed.
+void QChartMX::Signal::replotWaterfall(double x0, double x1) {
+  if ( ! isArray() || ! axis->size() )
+    return;
+  const QwtInterval zi = isnan(zMin)  ?  QwtInterval(0.0, 1.0)  :
+                         QwtInterval(zMin, zMax == zMin ? zMin + 1.0 : zMax);
+  static_cast<WaterfallData*>(spectrogram->data())->setBounds
+      ( QwtInterval(x0, x1), QwtInterval(0, waterfall.extent(1)), zi );
+  waterfallPlot->setAxisScale(QwtPlot::xBottom, x0, x1);
+  waterfallPlot->setAxisScale(QwtPlot::yLeft, 0, waterfall.extent(1));
+  waterfallPlot->replot();
+}
+
+
+void QChartMX::Signal::setArrayFile(const QString & fileName) {
+  if (arrayFile.isOpen())
+    arrayFile.close();
+  arrayFileName = fileName;
+}
+
+
+// The array row of the age on the signal's own axis, 0 being the newest.
+void QChartMX::Signal::recordArray(int pointNumber, int age) {
+  const int points = waterfall.extent(0);
+  if ( arrayFileName.isEmpty() || ! isArray() || ! points || age < 0 || age >= waterfallFilled )
+    return;
+  if ( ! arrayFile.isOpen() ) {
+    arrayFile.setFileName(arrayFileName);
+    arrayFile.open(QIODevice::Truncate | QIODevice::WriteOnly);
+  }
+  const qint32 head[2] = {pointNumber, elements};
+  arrayFile.write( (const char*) head, sizeof(head) );
+  arrayFile.write( (const char*) & waterfall( (waterfallHead - age + points) % points, 0 ),
+                   elements * sizeof(double) );
+}
 
-  double value = _pv->isConnected() ? _pv->get().toDouble() : NAN;
-  const int points = xData->size();
 
-  double deleted_value = data(points-1);
-  for ( int i = points-1 ; i > 0 ; i--)
-    data(i) = data(i-1);
-  data(0) = value;
+QVariant QChartMX::Signal::append(double value) {
+
+  double low = value, high = value;
+  if (aggregated) {
+    if (accum.count()) {
+      value = accum.mean();
+      low = accum.min();
+      high = accum.max();
+    }
+    lastAccum = accum;
+    accum.reset();
+  }
+
+  removedX = axis->size() && axis->count() == axis->size()  ?
+        axis->seconds(axis->size() - 1)  :  NAN ;
+  double deleted_value = data.push(value);
+  removedV = deleted_value;
+  double deleted_low = deleted_value, deleted_high = deleted_value;
+  if (aggregated) {
+    deleted_low = lowData.push(low);
+    deleted_high = highData.push(high);
+  }
 
+  // When aggregating the range covers the whole envelope.
   double oldMin = _min , oldMax = _max;
-  if ( ! isnan(deleted_value) && deleted_value <= _min )
-    _min = blitz::min(data);
-  if ( ! isnan(deleted_value) && deleted_value >= _max )
-    _max = blitz::max(data);
-  if ( ! isnan(value) && ( isnan(_min) || value < _min ) )
-    _min = value;
-  if ( ! isnan(value) && ( isnan(_max) || value > _max ) )
-    _max = value;
-
-  if (normalized) {
-    if (_min != oldMin || _max!= oldMax) {
-      preparePlot();
+  if ( ( ! isnan(deleted_low) && deleted_low <= _min ) ||
+       ( ! isnan(deleted_high) && deleted_high >= _max ) ) {
+    if (aggregated) {
+      _min = lowData.stats().min;
+      _max = highData.stats().max;
     } else {
-      for ( int i = points-1 ; i > 0 ; i--)
-        normal_data(i) = normal_data(i-1);
-      if (logscaled) {
-        double norma = qMax(qAbs(_min), qAbs(_max));
-        if ( norma == 0.0 )
-          normal_data(0) = value;
-        else
-          normal_data(0) = value / norma;
-      } else if (_max == _min) {
-        normal_data(0) = ( _max==0.0 ) ? 0.0 : 1.0 ;
-      } else {
-        normal_data(0) = (value-_min) / (_max-_min);
-      }
+      const LineStats st = data.stats();
+      _min = st.min;
+      _max = st.max;
     }
   }
+  if ( ! isnan(low) && ( isnan(_min) || low < _min ) )
+    _min = low;
+  if ( ! isnan(high) && ( isnan(_max) || high > _max ) )
+    _max = high;
+
+  if ( normalized && (_min != oldMin || _max!= oldMax) )
+    preparePlot();
 
-  int dataSize = blitz::first(blitz_isnan(data));
-  if (dataSize < 0)
-    dataSize = xData->size();
-  if (dataSize != (int) curve->dataSize())
-    curve->setRawSamples(xData->data(),
-                         normalized ? normal_data.data() : data.data(),
-                         dataSize);
+  // the curve is drawn up to the newest NaN
+  if ( isnan(value) && validCount )
+    rescaled = true;
+  validCount = isnan(value)  ?  0  :  qMin(validCount+1, data.size()) ;
 
   return value;
 
 }
 
 
+// "x" or "x%" with x >= 0; false if the deadband is malformed.
+static bool parseDeadband(QString spec, double & band, bool & relative) {
+  relative = spec.endsWith('%');
+  if (relative)
+    spec.chop(1);
+  bool ok;
+  band = spec.toDouble(&ok);
+  return ok && band >= 0;
+}
+
+
+bool QChartMX::Signal::isDeadbandValid() const {
+  double band;
+  bool relative;
+  return deadband().isEmpty() || parseDeadband(deadband(), band, relative);
+}
+
+
+bool QChartMX::Signal::withinDeadband(double value) const {
+  double band;
+  bool relative;
+  if ( ! hasRecorded || deadband().isEmpty() ||
+       ! parseDeadband(deadband(), band, relative) )
+    return false;
+  if ( isnan(value) || isnan(lastRecorded) )
+    return isnan(value) && isnan(lastRecorded);
+  if (relative)
+    band *= qAbs(lastRecorded) / 100;
+  return qAbs(value - lastRecorded) <= band;
+}
+
+
+void QChartMX::Signal::noteRecorded(double value) {
+  hasRecorded = true;
+  lastRecorded = value;
+}
+
+
+QString QChartMX::Signal::aggregateColumns() const {
+  if ( ! aggregated || ! data.size() )
+    return QString();
+  return QString::number(lowData.value(0)) + " " +
+         QString::number(highData.value(0)) + " " +
+         QString::number(lastAccum.std()) + " " +
+         QString::number(lastAccum.count());
+}
+
+
+void QChartMX::Signal::setAggregated(bool agg) {
+  aggregated = agg;
+  const int points = agg ? data.size() : 0;
+  lowData.resize(points);
+  highData.resize(points);
+  accum.reset();
+  lastAccum.reset();
+  envelope->setVisible(aggregated && ! normalized);
+}
+
+
+void QChartMX::Signal::setPrecision(SampleBuffer::Precision prec) {
+  data.setPrecision(prec);
+  lowData.setPrecision(prec);
+  highData.setPrecision(prec);
+}
+
 
 void QChartMX::Signal::resetData() {
-  int points = xData->size();
   _min = NAN;
   _max = NAN;
-  data.resize(points);
-  data = NAN;
-  normal_data.resize(points);
-  normal_data = NAN;
+  validCount = 0;
+  windowStats.reset();
+  statsUpdates = 0;
+  statsLabel->clear();
+  statsShown.invalidate();
+  const int every = sampledEvery();
+  ticksLeft = 0;
+  if ( every > 1 ) {
+    const int points = sparsePoints(chartAxis->size(), every);
+    sparseAxis.setTimestamped(chartAxis->isTimestamped());
+    sparseAxis.resize(points, QDateTime::currentMSecsSinceEpoch());
+    sparseAxis.setSpan( chartAxis->size()  ?
+                          chartAxis->width() * every * points / chartAxis->size()  :  0.0 );
+    sparseAxis.setStride(every, chartAxis->newest() + 1 - every); // sampled on the next tick
+    axis = &sparseAxis;
+  } else {
+    axis = chartAxis;
+  }
+  if ( ! frozen ) {
+    curve->setData(new SignalSeries(&data, axis, &validCount, &_min, &_max));
+    envelope->setData(new EnvelopeData(&lowData, &highData, axis, &validCount, &_min, &_max));
+  }
+  spectrogram->setData(new WaterfallData(&waterfall, &waterfallHead, &waterfallFilled,
+                                           &waterfallWrites, axis));
+  data.resize(axis->size());
+  setAggregated(aggregated);
+  if ( isArray() )
+    resetWaterfall();
   preparePlot();
-  curve->setRawSamples(xData->data(),
-                       normalized ? normal_data.data() : data.data(), 0);
+}
+
+
+bool QChartMX::Signal::tick() {
+  if ( --ticksLeft > 0 )
+    return false;
+  ticksLeft = sampledEvery();
+  return true;
+}
+
+
+void QChartMX::Signal::advance(qint64 msec) {
+  if ( axis == &sparseAxis )
+    sparseAxis.advance(msec);
+}
+
+
+double QChartMX::Signal::sampleAt(int age) const {
+  return axis == chartAxis  ?  data.value(age)  :  sampleAtX(chartAxis->x(age)) ;
+}
+
+
+int QChartMX::Signal::ownAge(int age) const {
+  if ( axis == chartAxis )
+    return age;
+  const double xx = chartAxis->x(age);
+  if ( isnan(xx) )
+    return -1;
+  const int own = axis->age(xx);
+  return ( own >= 0 && axis->x(own) == xx )  ?  own  :  -1 ;
+}
+
+
+double QChartMX::Signal::sampleAtX(double xx) const {
+  if ( isnan(xx) )
+    return NAN;
+  const int age = axis->age(xx);
+  return ( age >= 0 && axis->x(age) == xx )  ?  data.value(age)  :  NAN ;
+}
+
+
+// The sample pushed out by the last append() for a signal sampled on every
+// tick; otherwise the sample at the row's x which is still in the buffer.
+double QChartMX::Signal::leavingValue(double xx) const {
+  return axis == chartAxis  ?  removedV  :  sampleAtX(xx) ;
+}
+
+
+// Called once the axis has advanced to the sample added by append(). The
+// statistics are rebuilt from the window once per window length, which
+// keeps the cost O(1) per sample on average and drops the rounding (and
+// any re-quantization of the stored samples) accumulated by the updates.
+// The percentiles walk the histogram, so the label is refreshed at most
+// once per analysisInterval.
+void QChartMX::Signal::updateStatistics() {
+  if ( ++statsUpdates >= data.size() ) {
+    windowStats.reset();
+    for (int age = axis->count() - 1 ; age >= 0 ; age--)
+      windowStats.add(axis->seconds(age), data.value(age));
+    statsUpdates = 0;
+  } else {
+    windowStats.remove(removedX, removedV);
+    windowStats.add(axis->seconds(0), data.value(0));
+  }
+  if ( ! windowStats.count() ) {
+    statsLabel->clear();
+    statsShown.invalidate();
+    return;
+  }
+  if ( statsShown.isValid() && statsShown.elapsed() < analysisInterval )
+    return;
+  statsShown.start();
+  statsLabel->setText( QString("%1 ± %2  [%3 %4 %5]  %6/s")
+                       .arg(windowStats.mean(), 0, 'g', 6)
+                       .arg(windowStats.std(), 0, 'g', 3)
+                       .arg(windowStats.percentile(5), 0, 'g', 4)
+                       .arg(windowStats.percentile(50), 0, 'g', 4)
+                       .arg(windowStats.percentile(95), 0, 'g', 4)
+                       .arg(windowStats.slope(), 0, 'g', 3) );
 }
 
 
 void QChartMX::Signal::preparePlot() {
-  if (logscaled) {
-    double norma = qMax(qAbs(_min), qAbs(_max));
-    if ( norma != 0.0 )
-      normal_data = data / norma;
-  } else if (_max == _min) {
-    normal_data = ( _max==0.0 ) ? 0.0 : 1.0 ;
+  const double mn = frozen ? frozenMin : _min , mx = frozen ? frozenMax : _max ;
+  double offset = 0.0, scale = 1.0, shift = 0.0;
+  if ( normalized && ! isnan(mn) ) {
+    if (logscaled) {
+      double norma = qMax(qAbs(mn), qAbs(mx));
+      if ( norma != 0.0 )
+        scale = 1.0/norma;
+    } else if (mx == mn) {
+      scale = 0.0;
+      shift = ( mx==0.0 ) ? 0.0 : 1.0 ;
+    } else {
+      offset = mn;
+      scale = 1.0/(mx-mn);
+    }
+  }
+  static_cast<SignalSeries*>(curve->data())->setTransform(offset, scale, shift);
+  envelope->setVisible(aggregated && ! normalized);
+  rescaled = true;
+}
+
+
+void QChartMX::Signal::freeze(bool val) {
+  frozen = val;
+  if (frozen) {
+    frozenData = data;
+    frozenLow = lowData;
+    frozenHigh = highData;
+    frozenCount = validCount;
+    frozenMin = _min;
+    frozenMax = _max;
+    const SampleAxis * fax = frozenAxis;
+    if ( axis == &sparseAxis ) {
+      frozenSparseAxis = sparseAxis;
+      fax = &frozenSparseAxis;
+    }
+    curve->setData(new SignalSeries(&frozenData, fax, &frozenCount, &frozenMin, &frozenMax));
+    envelope->setData(new EnvelopeData(&frozenLow, &frozenHigh, fax,
+                                       &frozenCount, &frozenMin, &frozenMax));
   } else {
-    normal_data = (data-_min) / (_max-_min);
+    frozenData = SampleBuffer();
+    frozenLow = SampleBuffer();
+    frozenHigh = SampleBuffer();
+    curve->setData(new SignalSeries(&data, axis, &validCount, &_min, &_max));
+    envelope->setData(new EnvelopeData(&lowData, &highData, axis, &validCount, &_min, &_max));
   }
-  curve->setRawSamples(xData->data(),
-                       normalized ? normal_data.data() : data.data(),
-                       curve->dataSize());
+  preparePlot();
 }
 
+
+void QChartMX::Signal::paintNewest(QwtPlotDirectPainter * painter) {
+  if ( ! validCount )
+    return;
+  const int last = qMin(validCount - 1, 1);
+  if ( envelope->isVisible() )
+    painter->drawSeries(envelope, 0, last);
+  painter->drawSeries(curve, 0, last);
+}
@@ -15,16 +15,40 @@
 #include <QColor>
 #include <QPen>
 #include <QLabel>
+#include <QSpinBox>
 #include <QTableWidget>
 
 
 #include <qtpv.h>
 #include <qwt_plot_curve.h>
 #include <qwt_plot_grid.h>
+#include <qwt_plot_intervalcurve.h>
+#include <qwt_plot_spectrogram.h>
+#include <qwt_plot.h>
+#include <qwt_plot_directpainter.h>
+#include <qwt_plot_zoomer.h>
+#include <qwt_plot_panner.h>
 
 #include <blitz/array.h>
 
+#include "perfmonitor.h"
+#include "groupread.h"
+#include "runningstats.h"
+#include "windowstats.h"
+#include "samplebuffer.h"
+#include "exporter.h"
+#include "publisher.h"
+#include "shmring.h"
+#include "expression.h"
+#include "trigger.h"
+#include "spectrum.h"
+#include "correlation.h"
+#include "history.h"
+#include "renderer.h"
+#include "pvpool.h"
+
 typedef blitz::Array<double,1> Line;
+typedef blitz::Array<double,2> Plane;
 
 
 
@@ -50,6 +74,31 @@ public:
   double interval() const;
   double period() const;
   bool isContinious() const;
+  bool isSnapshotRead() const;
+  bool isAggregated() const;
+  bool isAggregateRecorded() const;
+  QString storage() const;
+  double memoryBudget() const;
+  bool isRealTime() const;
+  QString publishAddress() const;
+  QString sharedMemory() const;
+  QString triggerMode() const;
+  QString triggerCondition() const;
+  double triggerLevel() const;
+  int triggerPre() const;
+  int triggerPost() const;
+  QString spectrumSignal() const;
+  QString spectrumWindow() const;
+  int spectrumAverages() const;
+  bool isCorrelationShown() const;
+  QString lagSignals() const;
+  double renderInterval() const;
+  QString renderFormat() const;
+  double connectTimeout() const;
+  bool isOnChangeRecorded() const;
+  QString signalStorage(const QString & pvName) const;
+  int signalEvery(const QString & pvName) const;
+  QString signalDeadband(const QString & pvName) const;
   QString saveDir() const;
   QString saveName() const;
   bool isAutoName() const;
@@ -61,6 +110,8 @@ public:
   bool isNormalized() const;
   bool isGridVisible() const;
   bool isControlCollapsed() const;
+  bool isPerformanceRecorded() const;
+  bool isFrozen() const;
 
   QStringList allSignals() const ;
   bool isRunning() const ;
@@ -71,6 +122,32 @@ public slots:
   void setInterval(double val);
   void setPeriod(double val);
   void setContinious(bool val);
+  void setSnapshotRead(bool val);
+  void setAggregated(bool val);
+  void setAggregateRecorded(bool val);
+  void setStorage(const QString & val);
+  void setMemoryBudget(double val);
+  void setRealTime(bool val);
+  void setPublishAddress(const QString & val);
+  void setSharedMemory(const QString & val);
+  void setTriggerMode(const QString & val);
+  void setTriggerCondition(const QString & val);
+  void setTriggerLevel(double val);
+  void setTriggerPre(int val);
+  void setTriggerPost(int val);
+  void setSpectrumSignal(const QString & val);
+  void setSpectrumWindow(const QString & val);
+  void setSpectrumAverages(int val);
+  void setCorrelationShown(bool val);
+  void setLagSignals(const QString & val);
+  void setRenderInterval(double val);
+  void setRenderFormat(const QString & val);
+  void setConnectTimeout(double val);
+  void setOnChangeRecorded(bool val);
+  bool renderPlots(const QString & fileName, const QSize & size=QSize());
+  void setSignalStorage(const QString & pvName, const QString & precision=QString());
+  void setSignalEvery(const QString & pvName, int every);
+  void setSignalDeadband(const QString & pvName, const QString & deadband);
   void setSaveDir(const QString & val);
   void setSaveName(const QString & val=QString());
   void setAutoName(bool val);
@@ -85,6 +162,8 @@ public slots:
   void setNormalized(bool norm);
   void setGridVisible(bool val);
   void setControlCollapsed(bool val);
+  void setPerformanceRecorded(bool val);
+  void setFrozen(bool val);
   void lock(bool val);
   void start();
   void stop();
@@ -109,7 +188,19 @@ private:
 
   QTimer * timer;
 
-  Line timeData;
+  SampleAxis timeAxis;
+  bool updateTimeScale(bool force=false); // true if the axis moved
+  bool updateRanges(bool force=false); // true if the Y axis changed
+  QElapsedTimer shrinkSince; // the automatic bounds could be narrower
+  QwtPlotDirectPainter * directPainter;
+  void replotNewest(bool full);
+  SampleAxis frozenAxis;
+  QwtPlotZoomer * zoomer;
+  QwtPlotPanner * panner;
+  HistoryIndex historyIndex;
+  History history;
+  QList<QStringList> heldRows; // of the table while frozen: point, time, values
+  void addTableRow(int pointNumber, const QString & time, const QStringList & values);
   int point;
   QwtPlotGrid * grid;
 
@@ -118,21 +209,89 @@ private:
   void constructSignalsLayout();
 
   int column(Signal* sig) const;
+  Signal * signal(const QString & pvName) const;
 
+  QStringList caSignals() const;
   QString tableWasSavedTo;
+  Exporter * exporter;
+  Publisher * publisher;
+  ShmRing shm;
+  void openSharedMemory();
+  QVector<double> rowValues; // newest sample of every signal, NaN if not sampled
+
+  Trigger trigger;
+  QVector<double> triggerRow; // newest sample of every signal, as the trigger sees it
+  QFile captureFile;
+  QTextStream captureStr;
+  int captureLeft;
+  int captureEvents;
+  void startCapture();
+  void writeCaptureRow(int age);
+  void exportBuffers(const QString & fileName);
+
+  Spectrum * spectrum;
+  QwtPlot * spectrumPlot;
+  QwtPlotCurve * spectrumCurve;
+  QElapsedTimer spectrumAge; // since the last computation started
+  void requestSpectrum();
+
+  Correlation correlation;
+  QStringList correlationSignals; // of the matrix, empty to rebuild it
+  int correlationUpdates; // since the last rebuild
+  QTableWidget * correlationTable;
+  QElapsedTimer correlationShown;
+  void updateCorrelation(double leavingX);
+  LagScan * lagScan;
+  QwtPlot * lagPlot;
+  QwtPlotCurve * lagCurve;
+  QElapsedTimer lagAge;
+  QStringList lagPair() const; // two signals of the chart or empty
+  void requestLagScan();
+
+  ConnectBarrier * barrier;
+  QList<QEpicsPv*> channels() const; // of all signals, to connect before the start
+
+  SnapshotRenderer * renderer;
+  QTimer * renderTimer;
+  void setRenderProblem(const QString & problem=QString());
+
   QFile dataFile;
   QTextStream dataStr;
+  bool gettingData;
+
+  GroupRead groupRead;
+  PerfMonitor perf;
+  QElapsedTimer perfShown;
+  void showPerformance(bool force=false);
 
 private slots:
 
   void browseAutoSave();
   void printResult();
   void openQti();
+  void exportFinished();
+  void applyPublish();
+  void replayTo(int client);
+  void applySharedMemory();
+  bool applyTrigger();
+  void applySpectrum();
+  void showSpectrum();
+  void applyLagScan();
+  void showLagScan();
+  void loadHistory();
+  void applyRender();
+  void autoRender();
+  void renderFinished();
   void startStop();
+  void startScan();
   void preparePlot();
+  void requestData();
   void getData();
   void logScale();
   void setRanges();
+  void applyStorage();
+  void applySampling();
+  void applyDeadband();
 
 signals:
 
@@ -149,14 +308,56 @@ private:
 
   double _min;
   double _max;
+  QString _name; // PV, or "=expression" of a derived signal
   QEpicsPv * _pv;
   QEpicsPv * _desc;
-  Line data;
-  Line normal_data;
-  const Line * xData; // from the parent
+  Expression expr;
+  QList<QEpicsPv*> inputs; // of the expression
+  QVector<double> inputValues;
+  void releaseInputs();
+  SampleBuffer data;
+  SampleBuffer lowData;  // envelope of the aggregated updates
+  SampleBuffer highData;
+  int validCount; // newest samples up to the first NaN: the plotted ones
+  const SampleAxis * chartAxis; // from the parent
+  const SampleAxis * axis; // chartAxis, or sparseAxis when sampled every few ticks
+  SampleAxis sparseAxis;
+  int ticksLeft; // till the next sample
+  bool frozen; // the curves show the copies below
+  SampleBuffer frozenData;
+  SampleBuffer frozenLow;
+  SampleBuffer frozenHigh;
+  int frozenCount;
+  double frozenMin;
+  double frozenMax;
+  const SampleAxis * frozenAxis; // from the parent
+  SampleAxis frozenSparseAxis;
   bool normalized;
   bool logscaled;
+  bool aggregated;
+  RunningStats accum;
+  RunningStats lastAccum;
+  WindowStats windowStats;
+  double removedX; // sample pushed out of the window by the last append()
+  double removedV;
+  bool hasRecorded; // into the data file since the scan started
+  double lastRecorded;
+  int statsUpdates; // since the last rebuild of windowStats
+  QElapsedTimer statsShown; // since the statistics label was refreshed
+  int elements; // of the PV, 0 for a scalar
+  Plane waterfall; // ring buffer of array values: time x element
+  int waterfallHead;
+  int waterfallFilled;
+  qint64 waterfallWrites; // rows ever written, for the redraw of the new ones
+  double zMin;
+  double zMax;
+  QwtPlotSpectrogram * spectrogram;
+  QString arrayFileName;
+  QFile arrayFile;
   void preparePlot();
+  QVariant appendArray(const QVariantList & list);
+  void setElements(int count);
+  void resetWaterfall();
 
 public:
 
@@ -164,26 +365,66 @@ public:
   QPushButton * rem;
   QComboBox * sig;
   QLabel * val;
+  QLabel * statsLabel;
+  QSpinBox * everyBox;
+  QLineEdit * deadbandEdit;
   QTableWidgetItem * tableItem;
   QwtPlotCurve * curve;
+  QwtPlotIntervalCurve * envelope;
+  QwtPlotCurve * historyCurve; // rows before the window, from the data file
+  QwtPlot * waterfallPlot;
 
   Signal(QChartMX* parent=0);
   ~Signal();
 
   QVariant get();
-  inline const QString & pv() const {return _pv->pv();};
+  // of a derived signal: the inputs among the names take their value from the
+  // row, e.g. the snapshot of the chart, the others their monitored value
+  QVariant get(const QStringList & names, const QVector<double> & row);
+  QVariant append(double value);
+  inline const QString & pv() const {return _name;};
+  inline bool isDerived() const {return _name.startsWith('=');}
   inline double min() const {return _min;}
   inline double max() const {return _max;}
+  QList<QEpicsPv*> channels() const; // read by get()
   void resetData();
+  inline int sampledEvery() const {return everyBox->value();}
+  // Deadband of the recorder: empty to record every sample, "0" to record
+  // changes only, "x" for changes by more than x and "x%" for changes by
+  // more than x% of the value recorded last.
+  inline QString deadband() const {return deadbandEdit->text().trimmed();}
+  bool isDeadbandValid() const;
+  bool withinDeadband(double value) const; // of the value recorded last
+  void noteRecorded(double value);
+  inline void forgetRecorded() {hasRecorded = false;}
+  bool tick(); // true if the signal is sampled on this tick of the chart
+  void advance(qint64 msec); // once the chart's axis has advanced
+  inline const SampleAxis & sampleAxis() const {return *axis;}
+  double sampleAt(int age) const; // at the age on the chart's axis, NaN if not sampled then
+  int ownAge(int age) const; // on the signal's axis of the chart's age, -1 if not sampled then
+  double sampleAtX(double xx) const;
+  double leavingValue(double xx) const; // of the chart's row which left the window
+  void updateStatistics();
   inline void setNormalized(bool nrm) {normalized=nrm; preparePlot(); }
   inline void setLogarithmic(bool log) {logscaled=log; preparePlot(); }
+  void setAggregated(bool agg);
+  QString aggregateColumns() const;
+  int forcedPrecision; // -1 if chosen by the chart
+  bool rescaled; // not only the newest segment changed since the last replot
+  void paintNewest(QwtPlotDirectPainter * painter);
+  void freeze(bool val);
+  void setPrecision(SampleBuffer::Precision prec);
+  inline SampleBuffer::Precision precision() const {return data.precision();}
+  inline const SampleBuffer & samples() const {return data;}
+  inline int buffers() const {return aggregated ? 3 : 1;}
+  inline bool isArray() const {return elements;}
+  void replotWaterfall(double x0, double x1);
+  void setArrayFile(const QString & fileName=QString());
+  void recordArray(int pointNumber, int age=0); // into the array file
 
 private slots:
 
-  inline void setPV(const QString & pvname) {
-    _pv->setPV(pvname);
-    _desc->setPV(pvname+".DESC");
-  }
+  void setPV(const QString & pvname);
 
   inline void setConnected(bool con) {
     rem->setStyleSheet( con ? "" :
@@ -191,8 +432,10 @@ private slots:
     val->setText( con ? "" : "disconnected");
   }
 
+  void updateInputs();
+
   inline void setHeader() {
-    QString header = _pv->pv();
+    QString header = _name;
     if (_desc->isConnected())
       header += '\n' + _desc->get().toString();
     tableItem->setText(header);
@@ -200,7 +443,14 @@ private slots:
 
 
   inline void updateValue(const QVariant & data) {
+    if ( data.type() == QVariant::List ) {
+      setElements(data.toList().size());
+      val->setText( QString("[%1]").arg(data.toList().size()) );
+      return;
+    }
+    setElements(0);
     val->setText(data.toString());
+    accum.add(data.toDouble());
   }
 
 };
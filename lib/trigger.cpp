@@ -0,0 +1,107 @@
+#include <math.h>
+
+#include "trigger.h"
+
+
+QString Trigger::name(Mode mode) {
+  switch (mode) {
+    case Off:     return "off";
+    case Above:   return "above";
+    case Below:   return "below";
+    case Rising:  return "rising";
+    case Falling: return "falling";
+    case NonZero: return "nonzero";
+  }
+  return QString();
+}
+
+Trigger::Mode Trigger::fromName(const QString & nm, bool * ok) {
+  const Mode all[] = {Off, Above, Below, Rising, Falling, NonZero};
+  for (int idx = 0 ; idx < 6 ; idx++)
+    if ( nm == name(all[idx]) ) {
+      if (ok) *ok = true;
+      return all[idx];
+    }
+  if (ok) *ok = false;
+  return Off;
+}
+
+
+Trigger::Trigger() :
+  _mode(Off),
+  level(0.0),
+  previous(NAN),
+  armed(false),
+  cleared(true)
+{}
+
+
+bool Trigger::setup(Mode mode, const QString & condition, double _level,
+                    const QStringList & signalNames) {
+
+  _mode = Off;
+  _error.clear();
+  names = signalNames;
+  columns.clear();
+  level = _level;
+  previous = NAN;
+  armed = true;
+  cleared = true;
+  if ( mode == Off )
+    return true;
+
+  if ( ! expr.compile(condition) ) {
+    _error = expr.error();
+    return false;
+  }
+  foreach (QString input, expr.inputs()) {
+    const int col = signalNames.indexOf(input);
+    if ( col < 0 ) {
+      _error = "\"" + input + "\" is not a signal of the chart";
+      return false;
+    }
+    columns << col;
+  }
+  inputs.fill(NAN, columns.size());
+  _mode = mode;
+  return true;
+
+}
+
+
+void Trigger::rearm() {
+  armed = true;
+  cleared = _mode != Above && _mode != Below; // the edges are new anyway
+}
+
+
+bool Trigger::test(const double * row) {
+
+  if ( _mode == Off )
+    return false;
+
+  for (int idx = 0 ; idx < columns.size() ; idx++)
+    inputs[idx] = row[columns[idx]];
+  const double value = expr.evaluate(inputs.constData());
+
+  bool fire = false;
+  switch (_mode) {
+    case Above:   fire = value > level; break;
+    case Below:   fire = value < level; break;
+    case Rising:  fire = previous < level && value >= level; break;
+    case Falling: fire = previous > level && value <= level; break;
+    case NonZero: fire = ( isnan(previous) || previous == 0.0 ) && ! isnan(value) && value != 0.0; break;
+    case Off:     break;
+  }
+  previous = value;
+
+  if ( ! fire ) {
+    cleared = true;
+    return false;
+  }
+  if ( ! armed || ! cleared )
+    return false;
+  armed = false;
+  return true;
+
+}
@@ -0,0 +1,66 @@
+#ifndef TRIGGER_H
+#define TRIGGER_H
+
+#include <QStringList>
+#include <QVector>
+
+#include "expression.h"
+
+
+// Condition tested on every row of the scan. The condition is an expression
+// of the signals of the chart (a single PV name being the simplest one),
+// evaluated from the row values at a constant cost per row:
+//  Above, Below     - fires while the value is above / below the level;
+//  Rising, Falling  - fires when the value crosses the level upwards /
+//                     downwards between two rows;
+//  NonZero          - fires when the value turns from zero (or NaN) to
+//                     non-zero, e.g. for a status PV.
+// After firing the trigger is disarmed until rearm(). Above and Below fire
+// again only once their condition has been false after the rearm().
+class Trigger {
+
+public:
+
+  enum Mode {
+    Off,
+    Above,
+    Below,
+    Rising,
+    Falling,
+    NonZero
+  };
+
+  static QString name(Mode mode);
+  static Mode fromName(const QString & nm, bool * ok=0);
+
+  Trigger();
+
+  // false with error() if the condition does not compile or uses a PV
+  // which is not among the signals
+  bool setup(Mode mode, const QString & condition, double level,
+             const QStringList & signalNames);
+  inline Mode mode() const {return _mode;}
+  inline const QStringList & signalNames() const {return names;}
+  inline const QString & error() const {return _error;}
+  inline bool isArmed() const {return armed;}
+  void rearm();
+
+  bool test(const double * row); // one value per signal
+
+private:
+
+  Mode _mode;
+  Expression expr;
+  QStringList names;
+  QVector<int> columns; // signal of every input of the expression
+  QVector<double> inputs;
+  double level;
+  double previous;
+  bool armed;
+  bool cleared; // the condition was false since the rearm()
+  QString _error;
+
+};
+
+
+#endif // TRIGGER_H
@@ -0,0 +1,113 @@
+#include <math.h>
+
+#include "windowstats.h"
+
+
+// Buckets are ordered as the values: 0 holds the anchor itself, positive
+// indices the values above it and negative ones, mirrored, those below.
+int WindowStats::bucket(double dv) {
+  if ( dv == 0.0 )
+    return 0;
+  int exp;
+  const double mant = frexp(fabs(dv), &exp); // [0.5, 1)
+  const int sub = qMin( (int) ( (mant - 0.5) * (2 << subBits) ), (1 << subBits) - 1 );
+  const int idx = ( exp + 1100 ) * (1 << subBits) + sub + 1;
+  return dv > 0  ?  idx  :  -idx ;
+}
+
+double WindowStats::bucketValue(int idx) {
+  if ( ! idx )
+    return 0.0;
+  const int k = qAbs(idx) - 1;
+  const int exp = k / (1 << subBits) - 1100;
+  const int sub = k % (1 << subBits);
+  const double val = ldexp( 0.5 + (sub + 0.5) / (2 << subBits), exp );
+  return idx > 0  ?  val  :  -val ;
+}
+
+
+
+WindowStats::WindowStats() {
+  reset();
+}
+
+
+void WindowStats::reset() {
+  anchored = false;
+  x0 = v0 = 0.0;
+  n = 0;
+  sx = sxx = sv = svv = sxv = 0.0;
+  buckets.clear();
+}
+
+
+void WindowStats::add(double x, double v) {
+  if ( isnan(v) || isnan(x) )
+    return;
+  if ( ! anchored ) {
+    x0 = x;
+    v0 = v;
+    anchored = true;
+  }
+  const double dx = x - x0, dv = v - v0;
+  n++;
+  sx += dx;
+  sxx += dx * dx;
+  sv += dv;
+  svv += dv * dv;
+  sxv += dx * dv;
+  buckets[bucket(dv)]++;
+}
+
+
+void WindowStats::remove(double x, double v) {
+  if ( isnan(v) || isnan(x) || ! n )
+    return;
+  const double dx = x - x0, dv = v - v0;
+  QMap<int, long>::iterator found = buckets.find(bucket(dv));
+  if ( found == buckets.end() ) // was not added: nothing to remove
+    return;
+  if ( ! --found.value() )
+    buckets.erase(found);
+  n--;
+  sx -= dx;
+  sxx -= dx * dx;
+  sv -= dv;
+  svv -= dv * dv;
+  sxv -= dx * dv;
+}
+
+
+double WindowStats::mean() const {
+  return n  ?  v0 + sv / n  :  NAN ;
+}
+
+
+double WindowStats::std() const {
+  if ( n < 2 )
+    return n ? 0.0 : NAN ;
+  const double var = ( svv - sv * sv / n ) / (n - 1);
+  return var > 0.0  ?  sqrt(var)  :  0.0 ;
+}
+
+
+double WindowStats::slope() const {
+  if ( n < 2 )
+    return NAN;
+  const double den = n * sxx - sx * sx;
+  return den > 0.0  ?  ( n * sxv - sx * sv ) / den  :  NAN ;
+}
+
+
+double WindowStats::percentile(double pc) const {
+  if ( ! n )
+    return NAN;
+  const double rank = qBound(0.0, pc, 100.0) / 100.0 * (n - 1);
+  long seen = 0;
+  for (QMap<int, long>::const_iterator it = buckets.constBegin() ; it != buckets.constEnd() ; ++it) {
+    seen += it.value();
+    if ( seen > rank )
+      return v0 + bucketValue(it.key());
+  }
+  return v0 + bucketValue( (buckets.constEnd() - 1).key() );
+}
@@ -0,0 +1,56 @@
+#ifndef WINDOWSTATS_H
+#define WINDOWSTATS_H
+
+#include <QMap>
+
+
+// Statistics of a sliding window kept up to date as samples enter (add)
+// and leave (remove) it, without rescanning the window:
+//  - mean and standard deviation from sums, O(1);
+//  - slope dv/dx by least squares from the same kind of sums, O(1);
+//  - percentiles from a log-linear histogram of v - anchor with 128
+//    buckets per power of two (within 0.8% of the distance from the
+//    anchor), O(log buckets) to update and O(buckets) to query, so they
+//    are meant to be read at display rate rather than per sample.
+// The sums are taken relative to the first sample after reset() (the
+// anchor) so that signals with a large offset keep their precision.
+// Removing exactly what was added keeps the sums exact up to rounding;
+// the owner should rebuild them from time to time (reset() and add())
+// so that rounding does not accumulate. NaNs are ignored.
+class WindowStats {
+
+public:
+
+  WindowStats();
+
+  void reset();
+  void add(double x, double v);
+  void remove(double x, double v);
+
+  inline long count() const {return n;}
+  double mean() const;
+  double std() const;
+  double slope() const;
+  double percentile(double pc) const; // pc in [0, 100]
+
+private:
+
+  static const int subBits = 7;
+  static int bucket(double dv);
+  static double bucketValue(int idx);
+
+  bool anchored;
+  double x0;
+  double v0;
+  long n;
+  double sx;
+  double sxx;
+  double sv;
+  double svv;
+  double sxv;
+  QMap<int, long> buckets;
+
+};
+
+
+#endif // WINDOWSTATS_H